@@ -26,8 +26,40 @@ typedef int PID;    // PID
 
 // Phase 3a
 
+/*
+ * VM options. Set these before P3_VmInit is called.
+ */
+typedef struct P3_VmOptions {
+    int inverted;       /* keep all mappings in one frame-indexed table, not per process */
+    int reaper;         /* free a quitting process's memory from a reaper daemon */
+} P3_VmOptions;
+
+extern P3_VmOptions     P3_vmOptions;
+
 int         P3PageTableGet(PID pid, USLOSS_PTE **table) CHECKRETURN;
 int         P3PageTableSet(PID pid, USLOSS_PTE *table) CHECKRETURN;
+int         P3PageTableLookup(PID pid, int page, USLOSS_PTE *pte) CHECKRETURN;
+int         P3PageTableUpdate(PID pid, int page, USLOSS_PTE *pte) CHECKRETURN;
+int         P3PageTableUnmapFrame(int frame, int *count) CHECKRETURN;
+int         P3Reap(void);
+
+/*
+ * Slabs in the VM arena. Each holds objects of one size.
+ */
+#define P3_SLAB_PAGE_TABLE  0   /* flat page tables */
+#define P3_SLAB_DIRECTORY   1   /* page table directories */
+#define P3_SLAB_LEAF        2   /* page table leaves */
+#define P3_SLAB_FAULT       3   /* the pagers' fault records */
+#define P3_SLAB_RMAP        4   /* reverse map entries */
+#define P3_SLAB_FRAME_LIST  5   /* the pagers' lists of pages and frames */
+#define P3_SLAB_PAGE        6   /* page-sized swap buffers */
+#define P3_SLAB_CLUSTER     7   /* swap buffers a cluster of pages long */
+#define P3_SLABS            8
+
+int         P3SlabInit(int slab, int size, int count) CHECKRETURN;
+void       *P3SlabAlloc(int slab);
+void        P3SlabFree(int slab, void *object);
+void       *P3ArenaAlloc(int size);
 
 
 // Phase 3b
@@ -43,15 +75,169 @@ int         P3FrameFreeAll(PID pid) CHECKRETURN;
 int         P3FrameMap(int frame, void **addr) CHECKRETURN;
 int         P3FrameUnmap(int frame) CHECKRETURN;
 
+/*
+ * Frame descriptors, owned by the frame layer and shared with the swap layer. Each
+ * field is its own array indexed by frame, so a scan of one field, such as the clock's
+ * flags or the ager's ages, walks contiguous memory. Hold sem while using them.
+ */
+#define P3_FRAME_BUSY       0x1 /* being read or written by the swap layer */
+#define P3_FRAME_READAHEAD  0x2 /* swapped in by readahead and not referenced yet */
+
+typedef struct P3_Frames {
+    PID             *pid;       /* owner, -1 if the frame is free */
+    int             *page;      /* the owner's page in the frame */
+    unsigned char   *flags;     /* P3_FRAME_* */
+    unsigned char   *age;       /* aging counter for P3_REPLACE_AGING */
+    int             *slot;      /* swap slot that holds the page, -1 if none yet */
+    SID             sem;        /* protects the descriptors */
+    int             waiters;    /* # of processes waiting for a frame that isn't busy */
+    SID             idle;       /* V'ed for a waiter when a busy frame stops being busy */
+} P3_Frames;
+
+extern P3_Frames        P3_frames;
+
+void        P3FrameOwnerSet(int frame, PID pid, int page);
+
+/*
+ * Pager options. Set these before P3_VmInit is called.
+ */
+typedef struct P3_PagerOptions {
+    int loadControl;    /* suspend processes when the system is thrashing */
+    int loadInterval;   /* seconds between load control checks */
+    int thrashFaults;   /* faults per interval at or above which the system may be thrashing */
+    int thrashBusy;     /* pager utilization (percent) at or above which the system is thrashing */
+    int readahead;      /* swap in the pages ahead of a sequential stream of faults */
+    int readaheadMax;   /* largest readahead window, in pages */
+    int faultAround;    /* default fault-around block size, in pages (0 or 1 is off) */
+    int faultAroundReserve; /* don't fault around unless more frames than this are free */
+    char *profile;      /* file that holds fault profiles (NULL is off) */
+    int profilePages;   /* # of pages recorded in a process's profile */
+    int profileBatch;   /* # of profiled pages prefetched at a time */
+    int asyncSwap;      /* overlap a victim's write with the fault's read, and readahead reads */
+} P3_PagerOptions;
+
+/*
+ * Pager statistics that aren't part of P3_VmStats.
+ */
+typedef struct P3_PagerStats {
+    int suspends;       /* # of processes suspended by load control */
+    int resumes;        /* # of processes resumed by load control */
+    int suspendFrames;  /* # of frames taken from suspended processes */
+    int prepaged;       /* # of pages brought back when a suspended process resumed */
+    int readaheads;     /* # of pages swapped in ahead of a fault */
+    int readaheadHits;  /* # of those pages that were referenced */
+    int readaheadMisses;/* # of those pages that were replaced without being referenced */
+    int faultArounds;   /* # of new pages mapped around a faulting page */
+    int profileSpawns;  /* # of spawns that had a fault profile */
+    int profilePrefetches; /* # of pages prefetched from fault profiles */
+    int profileSaves;   /* # of fault profiles recorded */
+    int profiledRuns;   /* # of processes with a profile that quit */
+    int profiledFaults; /* # of faults they took */
+    int profiledUsecs;  /* total time they ran, spawn to quit */
+    int unprofiledRuns; /* same for the processes recorded without a profile */
+    int unprofiledFaults;
+    int unprofiledUsecs;
+    int overlapped;     /* # of faults whose read overlapped the victim's write */
+    int tableReloads;   /* # of page tables installed in the MMU */
+    int reloadsSkipped; /* # of mapping changes that didn't reload a page table */
+} P3_PagerStats;
+
+extern P3_PagerOptions  P3_pagerOptions;
+extern P3_PagerStats    P3_pagerStats;
+
 int         P3PagerInit(int pages, int frames, int pagers) CHECKRETURN;
 int         P3PagerShutdown(void)  CHECKRETURN;
+int         P3PagerSetFaultAround(PID pid, int pages) CHECKRETURN;
+int         P3PagerSpawn(PID pid) CHECKRETURN;
 
 // Phase 3d
 
+/*
+ * Page replacement policies used by P3SwapOut.
+ */
+#define P3_REPLACE_CLOCK    0   /* single reference bit, second chance */
+#define P3_REPLACE_AGING    1   /* 8-bit age counters sampled periodically */
+
+/*
+ * Swap options. Set these before P3_VmInit is called.
+ */
+typedef struct P3_SwapOptions {
+    int replacement;    /* P3_REPLACE_CLOCK or P3_REPLACE_AGING */
+    int agingInterval;  /* seconds between reference bit samples */
+    int local;          /* take victims from processes over their resident set target */
+    int initialTarget;  /* initial resident set target, in frames */
+    int pffGrow;        /* grow the target if faults are closer than this (usecs) */
+    int pffShrink;      /* shrink the target if faults are farther than this (usecs) */
+    int cluster;        /* most slots P3SwapIn reads at once (1 is off) */
+    int clusterCache;   /* # of slots read by a cluster that are kept in memory */
+    int clusterTTL;     /* how long a cached slot is kept (usecs) */
+    int elevator;       /* schedule swap I/O in C-SCAN order and merge adjacent requests */
+    int ioDeadline;     /* a request waiting longer than this (usecs) goes next */
+    int async;          /* issue swap I/O from a scheduler process so it overlaps the caller */
+    int units;          /* # of disk units swap is striped across, starting with P3_SWAP_DISK */
+    int stripe;         /* # of consecutive slots on one unit before moving to the next */
+    int fastSlots;      /* # of evicted pages kept in the in-memory fast tier (0 is off) */
+    int demoteAge;      /* demote a fast slot to the disk after this long unused (usecs) */
+    int migrateInterval;/* seconds between checks for fast slots to demote */
+    int compress;       /* pack compressible pages several to a swap block */
+    int extents;        /* place a process's pages in track-aligned runs of slots */
+    int compactInterval;/* seconds between swap compaction passes (0 is off) */
+    int compactBatch;   /* most slots moved by one compaction pass */
+} P3_SwapOptions;
+
+/*
+ * Swap statistics that aren't part of P3_VmStats.
+ */
+typedef struct P3_SwapStats {
+    int agingSamples;   /* # of times the ager sampled the reference bits */
+    int localVictims;   /* # of victims taken from processes over their target */
+    int targetGrows;    /* # of times a resident set target grew */
+    int targetShrinks;  /* # of times a resident set target shrank */
+    int clusterReads;   /* # of swap reads of more than one slot */
+    int clusterPages;   /* # of extra slots those reads brought in */
+    int clusterHits;    /* # of swap-ins satisfied from the cluster cache */
+    int clusterExpired; /* # of cached slots dropped without being used */
+    int prepagePages;   /* # of pages read by P3SwapInBatch */
+    int prepageReads;   /* # of disk reads P3SwapInBatch used for them */
+    int ioRequests;     /* # of requests to the swap I/O scheduler */
+    int ioMerges;       /* # of requests merged into another */
+    int ioSeekTracks;   /* total # of tracks the head moved between requests */
+    int ioMaxDepth;     /* most requests queued at once */
+    int ioDepthSum;     /* sum of the queue depth seen by each request */
+    int unitIOs[USLOSS_DISK_UNITS]; /* # of requests to each disk unit */
+    int fastPuts;       /* # of evicted pages put in the fast tier */
+    int fastHits;       /* # of swap-ins satisfied from the fast tier */
+    int fastDemotions;  /* # of fast slots written to the disk */
+    int slowHits;       /* # of swap-ins read from the disk */
+    int packedPages;    /* # of page writes that went into a pack */
+    int packWrites;     /* # of packs written */
+    int packReads;      /* # of packs read */
+    int unpackedPages;  /* # of page writes that didn't compress */
+    int extentsReserved;/* # of runs of slots reserved for a process */
+    int extentPlaced;   /* # of pages placed at their offset in their run */
+    int extentMisses;   /* # of pages that went in the first free slot instead */
+    int fragProcesses;  /* # of processes whose swap space was measured when they quit */
+    int fragSlots;      /* total # of slots those processes had */
+    int fragRuns;       /* total # of runs of consecutive slots those slots formed */
+    int freeRunsMax;    /* most runs of free slots seen */
+    int largestFreeMin; /* smallest largest run of free slots seen */
+    int compactPasses;  /* # of compaction passes */
+    int compactMoves;   /* # of slots moved by compaction */
+} P3_SwapStats;
+
+extern P3_SwapOptions   P3_swapOptions;
+extern P3_SwapStats     P3_swapStats;
+
 int         P3SwapInit(int pages, int frames) CHECKRETURN;
 int         P3SwapShutdown(void) CHECKRETURN;
 int         P3SwapFreeAll(PID pid) CHECKRETURN;
 int         P3SwapOut(int *frame) CHECKRETURN;
+int         P3SwapOutStart(int *frame, int *io) CHECKRETURN;
+int         P3SwapOutProcess(PID pid, int *frames, int *count) CHECKRETURN;
 int         P3SwapIn(PID pid, int page, int frame) CHECKRETURN;
+int         P3SwapInStart(PID pid, int page, int frame, int *io) CHECKRETURN;
+int         P3SwapFinish(int io) CHECKRETURN;
+int         P3SwapInBatch(PID pid, int *pages, int *frames, int count) CHECKRETURN;
+int         P3SwapCached(PID pid, int page);
 
 #endif
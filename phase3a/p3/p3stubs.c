@@ -33,6 +33,7 @@ int P3FrameUnmap(int frame) CHECKRETURN;
 
 int P3PagerInit(int pages, int frames, int pagers) {return P1_SUCCESS;}
 int P3PagerShutdown(void) {return P1_SUCCESS;}
+int P3PagerSpawn(PID pid) {return P1_SUCCESS;}
 
 // Phase 3d
 
@@ -20,6 +20,143 @@
 #include "phase3Int.h"
 
 static USLOSS_PTE   *pageTables[P1_MAXPROC];
+
+/*
+ * Each process's PTEs are kept two levels deep: a directory with one entry per
+ * LEAF_PAGES consecutive pages, pointing at a leaf that holds their PTEs. A leaf is
+ * allocated the first time one of its pages is mapped, so the PTEs a process has
+ * scale with the parts of the VM region it touched. The flat table the MMU walks
+ * (pageTables) is updated in step with the leaves by P3PageTableUpdate.
+ */
+#define LEAF_PAGES  16
+
+typedef struct Leaf {
+    int         mapped;             // # of entries that are incore
+    USLOSS_PTE  ptes[LEAF_PAGES];
+} Leaf;
+
+/*
+ * A process gets its directory the first time one of its pages is mapped. Until then its
+ * entry in pageTables is the sentinel, a flat table shared by every such process in which
+ * no page is incore, so a process that never touches the VM region costs nothing here.
+ * Phase 1 keeps the table P3_AllocatePageTable returns and installs it each time the
+ * process is dispatched, so each pid has a flat table of its own that is set aside when
+ * the VM starts and handed to phase 1 at spawn. It has no page incore until the first
+ * mapping moves the process off the sentinel onto it, and is cleared when the process
+ * quits. In inverted mode phase 1 gets the sentinel instead.
+ * If phase 3b isn't there to handle faults every page is mapped at spawn instead.
+ */
+static USLOSS_PTE   *sentinel = NULL;
+static USLOSS_PTE   *slots[P1_MAXPROC];     // each pid's flat table, NULL if it has none
+static int          identity = FALSE;   // map every page to its own frame at spawn
+
+static Leaf     **directories[P1_MAXPROC];
+static int      leavesNum = 0;      // # of entries in a directory
+static int      directorySem;       // protects leaf allocation and the inverted table
+
+/*
+ * In inverted mode (P3_vmOptions.inverted) the mappings of every process are kept in
+ * one table indexed by frame instead, and a chain of frames per hash bucket finds the
+ * frame that holds a (pid, page). Processes never leave the sentinel, so phase 1 puts
+ * it back each time one is dispatched and the process's first access faults; the
+ * fault handler then installs the flat table P3PageTableGet builds for it from the
+ * inverted table. Building one scans every frame, so the tables of the last few
+ * processes are kept as views, and P3PageTableUpdate and P3PageTableUnmapFrame keep
+ * them up to date. A process that is switched back to while it still has a view gets
+ * it without a scan; only a process without one costs O(frames), and the least
+ * recently used view is rebuilt for it.
+ */
+typedef struct Inverted {
+    PID         pid;                // -1 if the frame isn't mapped
+    int         page;
+    USLOSS_PTE  pte;
+    int         next;               // next frame in the hash chain, -1 if none
+} Inverted;
+
+#define INVERTED_HASH(pid, page) ((((pid) * 31) + (page)) & bucketsMask)
+
+static Inverted *inverted = NULL;   // indexed by frame
+static int      *buckets = NULL;    // first frame in each hash chain, -1 if none
+static int      bucketsMask = 0;    // # of buckets - 1, a power of 2 minus 1
+#define INVERTED_VIEWS 4   // # of flat tables built from the inverted table
+
+static USLOSS_PTE *views[INVERTED_VIEWS];
+static PID      viewPids[INVERTED_VIEWS];   // process each view is for, -1 if none
+static int      viewUsed[INVERTED_VIEWS];   // viewClock when each view was last asked for
+static int      viewClock = 0;
+static int      viewHits = 0;       // # of P3PageTableGet calls that found a view
+static int      viewBuilds = 0;     // # of views built by scanning the inverted table
+
+/*
+ * Reverse map. Each frame has a list of the (pid, page)s mapped to it, kept up to date
+ * by P3PageTableUpdate, so evicting a frame unmaps all of its pages without searching
+ * every page table, and a frame can be mapped by more than one process. In inverted
+ * mode a frame has at most one mapping and the inverted table is its reverse map.
+ */
+typedef struct Rmap {
+    PID             pid;
+    int             page;
+    struct Rmap     *next;
+} Rmap;
+
+static Rmap     **rmaps = NULL;     // indexed by frame, protected by directorySem
+
+/*
+ * With the reaper option (P3_vmOptions.reaper) a quitting process's swap slots, frames,
+ * and page table aren't freed on its way out. P3_FreePageTable queues its pid and the
+ * reaper daemon frees them in the background. A pager that finds no free frame reaps
+ * a queued process before it replaces a page, and a new process that reuses a queued
+ * pid reaps it before it gets its page table.
+ */
+static int      reapPending[P1_MAXPROC];    // TRUE if the pid is queued
+static PID      reapNext[P1_MAXPROC];       // next pid in the queue, -1 if none
+static PID      reapHead = -1;              // oldest queued pid, -1 if none
+static PID      reapTail = -1;
+static int      reapSem;            // protects the queue, held while a pid is reaped
+static int      reapWork;           // V'ed once for each pid queued
+static int      reaperDone;         // V'ed by the reaper when it quits
+static int      reaperRunning = FALSE;
+
+static int      reaped = 0;         // # of pids reaped
+static int      reapedByPagers = 0; // # of them reaped by a pager that needed a frame
+static int      reapedBySpawns = 0; // # of them reaped by a new process with their pid
+static int      reapMaxPending = 0; // most pids queued at once
+static int      reapPendingNum = 0;
+
+P3_VmOptions    P3_vmOptions = {
+    .inverted = 0,
+    .reaper = 0,
+};
+
+/*
+ * The VM arena. Memory the VM layer keeps while it is initialized comes from here and
+ * is freed all at once by ArenaDestroy when it shuts down. P3ArenaAlloc hands out
+ * memory that lives until then, such as the frame and swap tables. Objects that come
+ * and go, such as page tables and fault records, come from slabs of same-sized objects
+ * with a free list, so allocating and freeing one is O(1). A slab grows by a chunk of
+ * objects when its free list is empty.
+ */
+#define ARENA_ALIGN 16      // offset of a chunk's memory from its header
+#define LEAF_CHUNK  64      // # of leaves a chunk of the leaf slab holds
+
+typedef struct Chunk {
+    struct Chunk    *next;
+} Chunk;
+
+typedef struct Slab {
+    int     size;           // object size, 0 if the slab isn't initialized
+    int     count;          // # of objects in a chunk
+    void    *free;          // free list, linked through the objects' first word
+} Slab;
+
+static Chunk    *chunks = NULL;     // every chunk in the arena
+static Slab     slabs[P3_SLABS];
+static int      arenaSem;           // protects the arena
+
+static void         ArenaInit(void);
+static void         ArenaDestroy(void);
+static void        *ChunkAlloc(int size);
+
 static int	numPages = 0; // # of pages in a page table
 static int numFrames = 0; // # of frames in physical memory
 
@@ -32,6 +169,16 @@ static int initialized = FALSE;
 static int          MMUInit(int pages, int frames);
 static int          MMUShutdown(void);
 static int          PageTableFree(PID pid);
+static Leaf        *LeafGet(PID pid, int page, int allocate);
+static void         TableMaterialize(PID pid);
+static int          InvertedFind(PID pid, int page);
+static void         InvertedRemove(int frame);
+static int          ViewFind(PID pid);
+static void         RmapAdd(int frame, PID pid, int page);
+static void         RmapRemove(int frame, PID pid, int page);
+static void         MemoryFree(PID pid);
+static int          Reap(PID pid);
+static int          Reaper(void *arg);
 
 
 /*
@@ -76,7 +223,14 @@ P3_VmInit(int unused, int pages, int frames, int pagers)
 
     for (int i = 0; i < P1_MAXPROC; i++) {
         pageTables[i] = NULL;
+        directories[i] = NULL;
+        reapPending[i] = FALSE;
+        reapNext[i] = -1;
     }
+    reapHead = -1;
+    reapTail = -1;
+    reaped = reapedByPagers = reapedBySpawns = 0;
+    reapMaxPending = reapPendingNum = 0;
 
     USLOSS_IntVec[USLOSS_MMU_INT] = P3PageFaultHandler;
 
@@ -87,11 +241,68 @@ P3_VmInit(int unused, int pages, int frames, int pagers)
     }
     numPages = pages;
     numFrames = frames;
+    leavesNum = (pages + LEAF_PAGES - 1) / LEAF_PAGES;
+
+    result = P1_SemCreate("directory", 1, &directorySem);
+    assert(result == P1_SUCCESS);
     P3_vmStats.pages = pages;
     P3_vmStats.frames = frames;
 
     initialized = TRUE;
 
+    // a process's page table and directory never need a malloc
+    ArenaInit();
+    result = P3SlabInit(P3_SLAB_PAGE_TABLE, sizeof(USLOSS_PTE) * pages, P1_MAXPROC);
+    assert(result == P1_SUCCESS);
+    result = P3SlabInit(P3_SLAB_DIRECTORY, sizeof(Leaf *) * leavesNum, P1_MAXPROC);
+    assert(result == P1_SUCCESS);
+    result = P3SlabInit(P3_SLAB_LEAF, sizeof(Leaf), LEAF_CHUNK);
+    assert(result == P1_SUCCESS);
+    result = P3SlabInit(P3_SLAB_RMAP, sizeof(Rmap), frames);
+    assert(result == P1_SUCCESS);
+    rmaps = P3ArenaAlloc(sizeof(Rmap *) * frames);
+    sentinel = P3ArenaAlloc(sizeof(USLOSS_PTE) * pages);
+
+    // phase 3b's allocator returns NULL if it isn't there
+    USLOSS_PTE *probe = P3PageTableAllocateEmpty(pages);
+    identity = probe == NULL;
+    if (probe != NULL) {
+        P3SlabFree(P3_SLAB_PAGE_TABLE, probe);
+    }
+    for (int i = 0; i < P1_MAXPROC; i++) {
+        slots[i] = NULL;
+        if (!identity && !P3_vmOptions.inverted) {
+            slots[i] = P3PageTableAllocateEmpty(pages);
+        }
+    }
+
+    if (P3_vmOptions.inverted && !identity) {
+        int bucketsNum = 1;
+        while (bucketsNum < frames) {
+            bucketsNum *= 2;
+        }
+        bucketsMask = bucketsNum - 1;
+        buckets = P3ArenaAlloc(sizeof(int) * bucketsNum);
+        for (int i = 0; i < bucketsNum; i++) {
+            buckets[i] = -1;
+        }
+        inverted = P3ArenaAlloc(sizeof(Inverted) * frames);
+        for (int i = 0; i < frames; i++) {
+            inverted[i].pid = -1;
+            inverted[i].next = -1;
+        }
+        for (int i = 0; i < INVERTED_VIEWS; i++) {
+            views[i] = P3ArenaAlloc(sizeof(USLOSS_PTE) * pages);
+            viewPids[i] = -1;
+            viewUsed[i] = 0;
+        }
+        viewClock = viewHits = viewBuilds = 0;
+    }
+
+    // the pagers' page tables are allocated by P3PagerInit, and that checks the queue
+    result = P1_SemCreate("reap", 1, &reapSem);
+    assert(result == P1_SUCCESS);
+
     result = P3FrameInit(pages, frames);
     if (result != P1_SUCCESS) {
         USLOSS_Console("P3FrameInit failed: %d\n", result);
@@ -110,6 +321,17 @@ P3_VmInit(int unused, int pages, int frames, int pagers)
         goto done;
     }
 
+    if (P3_vmOptions.reaper) {
+        PID reaperPid;
+        result = P1_SemCreate("reapWork", 0, &reapWork);
+        assert(result == P1_SUCCESS);
+        result = P1_SemCreate("reaperDone", 0, &reaperDone);
+        assert(result == P1_SUCCESS);
+        reaperRunning = TRUE;
+        result = P1_Fork("reaper", Reaper, NULL, USLOSS_MIN_STACK, P3_PAGER_PRIORITY, 0, &reaperPid);
+        assert(result == P1_SUCCESS);
+    }
+
     result = P1_SUCCESS;
 done:
     return result;
@@ -137,6 +359,30 @@ P3_VmShutdown(void)
     CheckMode();
     if (initialized) {
 
+        // whatever the reaper hasn't gotten to is freed now
+        if (reaperRunning) {
+            reaperRunning = FALSE;
+            rc = P1_V(reapWork);
+            assert(rc == P1_SUCCESS);
+            rc = P1_P(reaperDone);
+            assert(rc == P1_SUCCESS);
+            rc = P1_SemFree(reapWork);
+            assert(rc == P1_SUCCESS);
+            rc = P1_SemFree(reaperDone);
+            assert(rc == P1_SUCCESS);
+        }
+        while (Reap(-1)) {
+        }
+        rc = P1_SemFree(reapSem);
+        assert(rc == P1_SUCCESS);
+        if (P3_vmOptions.reaper) {
+            USLOSS_Console("P3_VmShutdown: reaped: %d, by pagers: %d, by spawns: %d, most pending: %d\n",
+                reaped, reapedByPagers, reapedBySpawns, reapMaxPending);
+        }
+        if (inverted != NULL) {
+            USLOSS_Console("P3_VmShutdown: inverted views found: %d, built: %d\n", viewHits, viewBuilds);
+        }
+
         rc = P3PagerShutdown();
         assert(rc == P1_SUCCESS);
 
@@ -156,6 +402,13 @@ P3_VmShutdown(void)
                 pageTables[i] = NULL;
             }
         }
+        rc = P1_SemFree(directorySem);
+        assert(rc == P1_SUCCESS);
+        ArenaDestroy();
+        rmaps = NULL;
+        inverted = NULL;
+        buckets = NULL;
+        memset(views, 0, sizeof(views));
 
         initialized = FALSE;      
         P3_PrintStats(&P3_vmStats);
@@ -184,6 +437,7 @@ USLOSS_PTE *
 P3_AllocatePageTable(int pid)
 {
     USLOSS_PTE  *pageTable = NULL;
+    int         rc;
 
     CheckMode();
     if ((pid < 0) || (pid >= P1_MAXPROC)) {
@@ -191,11 +445,28 @@ P3_AllocatePageTable(int pid)
         goto done;
     }
     if (initialized) {
-        pageTable = P3PageTableAllocateEmpty(numPages);
-        if (pageTable == NULL) {
+        // the pid's last process may not have been reaped yet
+        if (Reap(pid)) {
+            reapedBySpawns++;
+        }
+        pageTables[pid] = sentinel;
+        pageTable = (slots[pid] != NULL) ? slots[pid] : sentinel;
+        if (identity) {
+            directories[pid] = P3SlabAlloc(P3_SLAB_DIRECTORY);
             pageTable = PageTableAllocateIdentity(numPages);
+            pageTables[pid] = pageTable;
+
+            // the identity table maps every page, so all its leaves are present
+            for (int page = 0; page < numPages; page++) {
+                rc = P3PageTableUpdate(pid, page, &pageTable[page]);
+                assert(rc == P1_SUCCESS);
+            }
+        }
+
+        rc = P3PagerSpawn(pid);
+        if (rc != P1_SUCCESS) {
+            USLOSS_Console("P3_AllocatePageTable: P3PagerSpawn(%d) failed: %d\n", pid, rc);
         }
-        pageTables[pid] = pageTable;
     }
 done:
     return pageTable;
@@ -208,7 +479,8 @@ done:
  *
  *	Called when a process quits and frees the page table 
  *	for the process and frees any frames and disk space used
- *  by the process.
+ *  by the process. With the reaper option they are freed later
+ *  by the reaper daemon instead.
  *
  * Parameters:
  *      pid: pid of process that is quitting
@@ -232,38 +504,117 @@ P3_FreePageTable(int pid)
         USLOSS_Console("P3_FreePageTable: invalid pid %d\n", pid);
         goto done;
     }
-    if ((initialized) && (pageTables[pid] != NULL)) {
-
-        rc = P3SwapFreeAll(pid);
-        if (rc != P1_SUCCESS) {
-            USLOSS_Console("P3_FreePageTable: P3SwapFreeAll(%d) failed: %d\n", pid, rc);
+    if ((initialized) && (pageTables[pid] != NULL) && (!reapPending[pid])) {
+        if (!reaperRunning) {
+            MemoryFree(pid);
             goto done;
         }
 
-        rc = P3FrameFreeAll(pid);
-        if (rc != P1_SUCCESS) {
-            USLOSS_Console("P3_FreePageTable: P3FrameFreeAll(%d) failed: %d\n", pid, rc);
-            goto done;
+        // the reaper frees it, the quitting process is done
+        rc = P1_P(reapSem);
+        assert(rc == P1_SUCCESS);
+        reapPending[pid] = TRUE;
+        reapNext[pid] = -1;
+        if (reapTail == -1) {
+            reapHead = pid;
+        } else {
+            reapNext[reapTail] = pid;
         }
-
-        rc = PageTableFree(pid);
-        if (rc != P1_SUCCESS) {
-            USLOSS_Console("P3_FreePageTable: PageTableFree(%d) failed: %d\n", pid, rc);
-            goto done;
+        reapTail = pid;
+        reapPendingNum++;
+        if (reapPendingNum > reapMaxPending) {
+            reapMaxPending = reapPendingNum;
         }
+        rc = P1_V(reapSem);
+        assert(rc == P1_SUCCESS);
+        rc = P1_V(reapWork);
+        assert(rc == P1_SUCCESS);
     }
 done:
     return;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3Reap --
+ *
+ *	Frees the memory of the process that has been waiting longest
+ *	for the reaper. The pagers call this when there are no free
+ *	frames, so a quitting process's frames are reused before a
+ *	live process's page is replaced.
+ *
+ * Results:
+ *	TRUE if a process was reaped, FALSE if none was waiting.
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3Reap(void)
+{
+    CheckMode();
+    if (!initialized || reapHead == -1) {
+        return FALSE;
+    }
+    if (!Reap(-1)) {
+        return FALSE;
+    }
+    reapedByPagers++;
+    return TRUE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3PageTableGet --
+ *
+ *	Returns the flat page table of a process, or NULL if it has none.
+ *	In inverted mode the table is a view of the inverted table and is
+ *	only good until INVERTED_VIEWS other processes have been asked
+ *	for, so only the running process's table should be asked for.
+ *
+ * Results:
+ *	P1_INVALID_PID:     the pid is invalid
+ *	P1_SUCCESS:         success
+ *
+ *----------------------------------------------------------------------
+ */
 int
 P3PageTableGet(PID pid, USLOSS_PTE **table)
 {
     int result = P1_SUCCESS;
+    int rc;
+
     if ((pid < 0) || (pid >= P1_MAXPROC)) {
         result = P1_INVALID_PID;
-    } else {
+    } else if ((inverted == NULL) || (pageTables[pid] == NULL)) {
         *table = pageTables[pid];
+    } else {
+        rc = P1_P(directorySem);
+        assert(rc == P1_SUCCESS);
+        int view = ViewFind(pid);
+        if (view != -1) {
+            viewHits++;
+        } else {
+            view = 0;
+            for (int i = 1; i < INVERTED_VIEWS; i++) {
+                if (viewUsed[i] < viewUsed[view]) {
+                    view = i;
+                }
+            }
+            memset(views[view], 0, sizeof(USLOSS_PTE) * numPages);
+            for (int frame = 0; frame < numFrames; frame++) {
+                if (inverted[frame].pid == pid) {
+                    views[view][inverted[frame].page] = inverted[frame].pte;
+                }
+            }
+            viewPids[view] = pid;
+            viewBuilds++;
+        }
+        viewUsed[view] = ++viewClock;
+        *table = views[view];
+        rc = P1_V(directorySem);
+        assert(rc == P1_SUCCESS);
     }
     return result;
 }
@@ -280,6 +631,326 @@ P3PageTableSet(PID pid, USLOSS_PTE *table)
     return result;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3PageTableLookup --
+ *
+ *	Returns the PTE for a page of a process. A page whose leaf was
+ *	never allocated isn't incore, nor is any page of a process that
+ *	is still on the sentinel.
+ *
+ * Results:
+ *	P1_INVALID_PID:     the pid is invalid or has no page table
+ *	P3_INVALID_PAGE:    the page is invalid
+ *	P1_SUCCESS:         success
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3PageTableLookup(PID pid, int page, USLOSS_PTE *pte)
+{
+    int result = P1_SUCCESS;
+    if ((pid < 0) || (pid >= P1_MAXPROC) || (pageTables[pid] == NULL)) {
+        result = P1_INVALID_PID;
+    } else if ((page < 0) || (page >= numPages)) {
+        result = P3_INVALID_PAGE;
+    } else if (inverted != NULL) {
+        int rc = P1_P(directorySem);
+        assert(rc == P1_SUCCESS);
+        int frame = InvertedFind(pid, page);
+        if (frame == -1) {
+            memset(pte, 0, sizeof(*pte));
+        } else {
+            *pte = inverted[frame].pte;
+        }
+        rc = P1_V(directorySem);
+        assert(rc == P1_SUCCESS);
+    } else {
+        Leaf *leaf = LeafGet(pid, page, FALSE);
+        if (leaf == NULL) {
+            memset(pte, 0, sizeof(*pte));
+        } else {
+            *pte = leaf->ptes[page % LEAF_PAGES];
+        }
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3PageTableUpdate --
+ *
+ *	Sets the PTE for a page of a process, allocating its leaf if the
+ *	page is mapped for the first time, and copies it into the flat
+ *	table the MMU uses. The first page a process maps moves it off
+ *	the sentinel onto a table of its own; the caller must install
+ *	that table with USLOSS_MmuSetPageTable if the process is running.
+ *
+ * Results:
+ *	P1_INVALID_PID:     the pid is invalid or has no page table
+ *	P3_INVALID_PAGE:    the page is invalid
+ *	P1_SUCCESS:         success
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3PageTableUpdate(PID pid, int page, USLOSS_PTE *pte)
+{
+    int result = P1_SUCCESS;
+    if ((pid < 0) || (pid >= P1_MAXPROC) || (pageTables[pid] == NULL)) {
+        result = P1_INVALID_PID;
+    } else if ((page < 0) || (page >= numPages)) {
+        result = P3_INVALID_PAGE;
+    } else if (inverted != NULL) {
+        int rc = P1_P(directorySem);
+        assert(rc == P1_SUCCESS);
+        int frame = InvertedFind(pid, page);
+        if (frame != -1) {
+            InvertedRemove(frame);
+        }
+        if (pte->incore) {
+            Inverted *entry = &inverted[pte->frame];
+            int bucket = INVERTED_HASH(pid, page);
+
+            // whatever was in the frame is gone
+            if (entry->pid != -1) {
+                int view = ViewFind(entry->pid);
+                if (view != -1) {
+                    views[view][entry->page].incore = 0;
+                }
+                InvertedRemove(pte->frame);
+            }
+            entry->pid = pid;
+            entry->page = page;
+            entry->pte = *pte;
+            entry->next = buckets[bucket];
+            buckets[bucket] = pte->frame;
+        }
+        int view = ViewFind(pid);
+        if (view != -1) {
+            views[view][page] = *pte;
+        }
+        rc = P1_V(directorySem);
+        assert(rc == P1_SUCCESS);
+    } else {
+        if (pte->incore && (pageTables[pid] == sentinel)) {
+            TableMaterialize(pid);
+        }
+        Leaf *leaf = LeafGet(pid, page, pte->incore);
+
+        // the old PTE, the reverse map, the leaf's count and the flat table change together
+        int rc = P1_P(directorySem);
+        assert(rc == P1_SUCCESS);
+        if (leaf != NULL) {
+            USLOSS_PTE *entry = &leaf->ptes[page % LEAF_PAGES];
+            if (entry->incore) {
+                RmapRemove(entry->frame, pid, page);
+            }
+            if (pte->incore) {
+                RmapAdd(pte->frame, pid, page);
+            }
+            leaf->mapped += pte->incore - entry->incore;
+            *entry = *pte;
+        }
+        if (pageTables[pid] != sentinel) {
+            pageTables[pid][page] = *pte;
+        }
+        rc = P1_V(directorySem);
+        assert(rc == P1_SUCCESS);
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3PageTableUnmapFrame --
+ *
+ *	Unmaps every page that is mapped to the frame, in whichever page
+ *	tables they are in.
+ *
+ * Results:
+ *	P3_INVALID_FRAME:   the frame is invalid
+ *	P1_SUCCESS:         success, *count is the # of pages unmapped
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3PageTableUnmapFrame(int frame, int *count)
+{
+    int         rc;
+    Rmap        *list = NULL;
+    USLOSS_PTE  pte;
+
+    *count = 0;
+    if ((frame < 0) || (frame >= numFrames)) {
+        return P3_INVALID_FRAME;
+    }
+
+    rc = P1_P(directorySem);
+    assert(rc == P1_SUCCESS);
+    if (inverted != NULL) {
+        if (inverted[frame].pid != -1) {
+            int view = ViewFind(inverted[frame].pid);
+            if (view != -1) {
+                views[view][inverted[frame].page].incore = 0;
+            }
+            InvertedRemove(frame);
+            *count = 1;
+        }
+    } else {
+        list = rmaps[frame];
+        rmaps[frame] = NULL;
+    }
+    rc = P1_V(directorySem);
+    assert(rc == P1_SUCCESS);
+
+    // the list was taken off the frame, so P3PageTableUpdate has nothing to remove
+    while (list != NULL) {
+        Rmap *next = list->next;
+        rc = P3PageTableLookup(list->pid, list->page, &pte);
+        if ((rc == P1_SUCCESS) && pte.incore && (pte.frame == frame)) {
+            pte.incore = 0;
+            rc = P3PageTableUpdate(list->pid, list->page, &pte);
+            assert(rc == P1_SUCCESS);
+            (*count)++;
+        }
+        P3SlabFree(P3_SLAB_RMAP, list);
+        list = next;
+    }
+    return P1_SUCCESS;
+}
+
+/*
+ * Records that the page of the process is mapped to the frame. Caller must hold directorySem.
+ */
+static void
+RmapAdd(int frame, PID pid, int page)
+{
+    Rmap *rmap = P3SlabAlloc(P3_SLAB_RMAP);
+
+    rmap->pid = pid;
+    rmap->page = page;
+    rmap->next = rmaps[frame];
+    rmaps[frame] = rmap;
+}
+
+/*
+ * Forgets that the page of the process is mapped to the frame, if it was. Caller must hold
+ * directorySem.
+ */
+static void
+RmapRemove(int frame, PID pid, int page)
+{
+    Rmap **link = &rmaps[frame];
+
+    while ((*link != NULL) && (((*link)->pid != pid) || ((*link)->page != page))) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        Rmap *rmap = *link;
+        *link = rmap->next;
+        P3SlabFree(P3_SLAB_RMAP, rmap);
+    }
+}
+
+/*
+ * Returns the leaf that holds the page's PTE, allocating it if it doesn't exist and
+ * allocate is set. Returns NULL if it doesn't exist and allocate isn't set.
+ */
+static Leaf *
+LeafGet(PID pid, int page, int allocate)
+{
+    int     rc;
+    Leaf    **entry;
+
+    if (directories[pid] == NULL) {
+        return NULL;
+    }
+    entry = &directories[pid][page / LEAF_PAGES];
+
+    if ((*entry == NULL) && allocate) {
+        rc = P1_P(directorySem);
+        assert(rc == P1_SUCCESS);
+        if (*entry == NULL) {
+            *entry = P3SlabAlloc(P3_SLAB_LEAF);
+        }
+        rc = P1_V(directorySem);
+        assert(rc == P1_SUCCESS);
+    }
+    return *entry;
+}
+
+/*
+ * Gives a process that is on the sentinel a directory, and moves it onto the flat table
+ * phase 1 already installs for it.
+ */
+static void
+TableMaterialize(PID pid)
+{
+    int rc;
+
+    rc = P1_P(directorySem);
+    assert(rc == P1_SUCCESS);
+    if (pageTables[pid] == sentinel) {
+        directories[pid] = P3SlabAlloc(P3_SLAB_DIRECTORY);
+        assert(slots[pid] != NULL);
+        rc = P3PageTableSet(pid, slots[pid]);
+        assert(rc == P1_SUCCESS);
+    }
+    rc = P1_V(directorySem);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Returns the frame that holds the page in the inverted table, or -1 if none does.
+ * Caller must hold directorySem.
+ */
+static int
+InvertedFind(PID pid, int page)
+{
+    int frame = buckets[INVERTED_HASH(pid, page)];
+
+    while ((frame != -1) && ((inverted[frame].pid != pid) || (inverted[frame].page != page))) {
+        frame = inverted[frame].next;
+    }
+    return frame;
+}
+
+/*
+ * Unlinks a frame from its hash chain and marks it unmapped. Caller must hold directorySem.
+ */
+static void
+InvertedRemove(int frame)
+{
+    Inverted    *entry = &inverted[frame];
+    int         *link = &buckets[INVERTED_HASH(entry->pid, entry->page)];
+
+    while (*link != frame) {
+        link = &inverted[*link].next;
+    }
+    *link = entry->next;
+    entry->pid = -1;
+    entry->next = -1;
+}
+
+/*
+ * Returns the view that holds the process's flat table, or -1 if none does. Caller must
+ * hold directorySem.
+ */
+static int
+ViewFind(PID pid)
+{
+    for (int i = 0; i < INVERTED_VIEWS; i++) {
+        if (viewPids[i] == pid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 static int
 MMUInit(int pages, int frames) 
 {
@@ -334,7 +1005,7 @@ PageTableAllocateIdentity(int pages)
 		int i;
 
 		//allocates memory for each page
-		table = malloc(sizeof(USLOSS_PTE) * pages);
+		table = P3SlabAlloc(P3_SLAB_PAGE_TABLE);
 		for (i = 0; i < pages; i++) {
 			
 			//sets each page's initial values
@@ -347,6 +1018,105 @@ PageTableAllocateIdentity(int pages)
     return table;
 }
 
+/*
+ * Frees a quitting process's swap slots, frames, and page table, in that order.
+ */
+static void
+MemoryFree(PID pid)
+{
+    int rc;
+
+    rc = P3SwapFreeAll(pid);
+    if (rc != P1_SUCCESS) {
+        USLOSS_Console("P3_FreePageTable: P3SwapFreeAll(%d) failed: %d\n", pid, rc);
+        return;
+    }
+
+    rc = P3FrameFreeAll(pid);
+    if (rc != P1_SUCCESS) {
+        USLOSS_Console("P3_FreePageTable: P3FrameFreeAll(%d) failed: %d\n", pid, rc);
+        return;
+    }
+
+    rc = PageTableFree(pid);
+    if (rc != P1_SUCCESS) {
+        USLOSS_Console("P3_FreePageTable: PageTableFree(%d) failed: %d\n", pid, rc);
+        return;
+    }
+}
+
+/*
+ * Takes a pid off the reaper's queue and frees its memory, or the oldest pid if pid
+ * is -1. Returns TRUE if a pid was reaped, FALSE if it wasn't queued.
+ */
+static int
+Reap(PID pid)
+{
+    int rc;
+    PID prev = -1;
+
+    rc = P1_P(reapSem);
+    assert(rc == P1_SUCCESS);
+    if (pid == -1) {
+        pid = reapHead;
+    } else if (!reapPending[pid]) {
+        pid = -1;
+    } else {
+        for (PID p = reapHead; p != pid; p = reapNext[p]) {
+            prev = p;
+        }
+    }
+    if (pid != -1) {
+        if (prev == -1) {
+            reapHead = reapNext[pid];
+        } else {
+            reapNext[prev] = reapNext[pid];
+        }
+        if (reapTail == pid) {
+            reapTail = prev;
+        }
+        reapNext[pid] = -1;
+
+        // the pid stays pending until its memory is gone, so a new process waits for it
+        MemoryFree(pid);
+        reapPending[pid] = FALSE;
+        reapPendingNum--;
+        reaped++;
+    }
+    rc = P1_V(reapSem);
+    assert(rc == P1_SUCCESS);
+    return pid != -1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Reaper --
+ *
+ *  Reaper daemon. Frees the memory of each process queued by
+ *  P3_FreePageTable, oldest first, until P3_VmShutdown is called.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+Reaper(void *arg)
+{
+    int rc;
+
+    while (1) {
+        rc = P1_P(reapWork);
+        assert(rc == P1_SUCCESS);
+        if (!reaperRunning) {
+            break;
+        }
+        // a pager or a new process may have reaped it already
+        (void) Reap(-1);
+    }
+    rc = P1_V(reaperDone);
+    assert(rc == P1_SUCCESS);
+    return 0;
+}
+
 /*
 * This function frees the page table connected with the process given via the pid.
 * If the pid is invalid or the pid does not have a page table, returns P1_INVALID_PID.
@@ -366,13 +1136,237 @@ PageTableFree(PID pid)
 			return P1_INVALID_PID;
 		}
 
-		// frees page table at the given pid	
-		free(pageTables[pid]);
+		// drops the process's mappings from the inverted table
+		if (inverted != NULL) {
+			int rc = P1_P(directorySem);
+			assert(rc == P1_SUCCESS);
+			for (int frame = 0; frame < numFrames; frame++) {
+				if (inverted[frame].pid == pid) {
+					InvertedRemove(frame);
+				}
+			}
+			int view = ViewFind(pid);
+			if (view != -1) {
+				viewPids[view] = -1;
+				viewUsed[view] = 0;
+			}
+			rc = P1_V(directorySem);
+			assert(rc == P1_SUCCESS);
+		}
+
+		// frees page table at the given pid, the pid's own table is only cleared for its next process
+		if (pageTables[pid] == slots[pid]) {
+			for (int page = 0; page < numPages; page++) {
+				slots[pid][page].incore = 0;
+			}
+		} else if (pageTables[pid] != sentinel) {
+			P3SlabFree(P3_SLAB_PAGE_TABLE, pageTables[pid]);
+		}
 		pageTables[pid] = NULL;
+
+		// frees the leaves and the directory, and the reverse map entries of their pages
+		if (directories[pid] != NULL) {
+			int rc = P1_P(directorySem);
+			assert(rc == P1_SUCCESS);
+			for (int i = 0; i < leavesNum; i++) {
+				Leaf *leaf = directories[pid][i];
+				for (int j = 0; (leaf != NULL) && (leaf->mapped > 0) && (j < LEAF_PAGES); j++) {
+					if (leaf->ptes[j].incore) {
+						RmapRemove(leaf->ptes[j].frame, pid, i * LEAF_PAGES + j);
+					}
+				}
+			}
+			rc = P1_V(directorySem);
+			assert(rc == P1_SUCCESS);
+			for (int i = 0; i < leavesNum; i++) {
+				if (directories[pid][i] != NULL) {
+					P3SlabFree(P3_SLAB_LEAF, directories[pid][i]);
+				}
+			}
+			P3SlabFree(P3_SLAB_DIRECTORY, directories[pid]);
+			directories[pid] = NULL;
+		}
 	}
     return P1_SUCCESS;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3SlabInit --
+ *
+ *	Sets the size of the objects in a slab of the VM arena and how
+ *	many of them a chunk holds. The first chunk is allocated now, so
+ *	the first count allocations don't call malloc.
+ *
+ * Results:
+ *	P3_NOT_INITIALIZED: the arena doesn't exist
+ *	P1_SUCCESS:         success
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3SlabInit(int slab, int size, int count)
+{
+    int     result = P1_SUCCESS;
+    int     rc;
+
+    assert((slab >= 0) && (slab < P3_SLABS) && (slabs[slab].size == 0));
+    if (!initialized) {
+        result = P3_NOT_INITIALIZED;
+    } else {
+        rc = P1_P(arenaSem);
+        assert(rc == P1_SUCCESS);
+
+        // the free list is linked through the objects themselves
+        if (size < (int) sizeof(void *)) {
+            size = sizeof(void *);
+        }
+        slabs[slab].size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+        slabs[slab].count = count > 0 ? count : 1;
+        slabs[slab].free = NULL;
+
+        rc = P1_V(arenaSem);
+        assert(rc == P1_SUCCESS);
+
+        P3SlabFree(slab, P3SlabAlloc(slab));
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3SlabAlloc --
+ *
+ *	Takes a zeroed object from a slab, growing the slab by a chunk if
+ *	its free list is empty.
+ *
+ * Results:
+ *	The object.
+ *
+ *----------------------------------------------------------------------
+ */
+void *
+P3SlabAlloc(int slab)
+{
+    Slab    *s = &slabs[slab];
+    void    *object;
+    int     rc;
+
+    assert((slab >= 0) && (slab < P3_SLABS) && (s->size != 0));
+
+    rc = P1_P(arenaSem);
+    assert(rc == P1_SUCCESS);
+    if (s->free == NULL) {
+        char *chunk = ChunkAlloc(s->size * s->count);
+        for (int i = s->count - 1; i >= 0; i--) {
+            *(void **) (chunk + i * s->size) = s->free;
+            s->free = chunk + i * s->size;
+        }
+    }
+    object = s->free;
+    s->free = *(void **) object;
+    rc = P1_V(arenaSem);
+    assert(rc == P1_SUCCESS);
+
+    memset(object, 0, s->size);
+    return object;
+}
+
+/*
+ * Puts an object from P3SlabAlloc back on its slab's free list.
+ */
+void
+P3SlabFree(int slab, void *object)
+{
+    int rc;
+
+    assert((slab >= 0) && (slab < P3_SLABS) && (slabs[slab].size != 0));
+
+    rc = P1_P(arenaSem);
+    assert(rc == P1_SUCCESS);
+    *(void **) object = slabs[slab].free;
+    slabs[slab].free = object;
+    rc = P1_V(arenaSem);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3ArenaAlloc --
+ *
+ *	Allocates zeroed memory that lives until the VM shuts down. It
+ *	can't be freed on its own.
+ *
+ * Results:
+ *	The memory.
+ *
+ *----------------------------------------------------------------------
+ */
+void *
+P3ArenaAlloc(int size)
+{
+    void    *memory;
+    int     rc;
+
+    assert(initialized);
+
+    rc = P1_P(arenaSem);
+    assert(rc == P1_SUCCESS);
+    memory = ChunkAlloc(size);
+    rc = P1_V(arenaSem);
+    assert(rc == P1_SUCCESS);
+    return memory;
+}
+
+/*
+ * Creates the arena, with every slab uninitialized.
+ */
+static void
+ArenaInit(void)
+{
+    int rc;
+
+    chunks = NULL;
+    memset(slabs, 0, sizeof(slabs));
+    rc = P1_SemCreate("arena", 1, &arenaSem);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Frees every chunk in the arena, and so everything allocated from it.
+ */
+static void
+ArenaDestroy(void)
+{
+    int rc;
+
+    while (chunks != NULL) {
+        Chunk *next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+    memset(slabs, 0, sizeof(slabs));
+    rc = P1_SemFree(arenaSem);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Allocates a zeroed chunk of the arena and returns its memory. Caller must hold arenaSem.
+ */
+static void *
+ChunkAlloc(int size)
+{
+    Chunk *chunk = calloc(1, ARENA_ALIGN + size);
+
+    assert(chunk != NULL);
+    chunk->next = chunks;
+    chunks = chunk;
+    return (char *) chunk + ARENA_ALIGN;
+}
+
 int P3_Startup(void *arg)
 {
     int pid;
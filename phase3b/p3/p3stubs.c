@@ -20,6 +20,7 @@ int P3FrameAllocate(PID pid, int *frame) {return P1_SUCCESS;}
 int P3FrameFreeAll(PID pid) {return P1_SUCCESS;}
 int P3PagerInit(int pages, int frames, int pagers) {return P1_SUCCESS;}
 int P3PagerShutdown(void) {return P1_SUCCESS;}
+int P3PagerSpawn(PID pid) {return P1_SUCCESS;}
 
 // Phase 3d
 
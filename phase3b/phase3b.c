@@ -48,14 +48,19 @@ P3PageFaultHandler(int type, void *arg)
 
 			// if a page fault exists
 			if (table[errorPage].incore == 0) {
-				table[errorPage].read = 1;
-				table[errorPage].write = 1;
-				table[errorPage].incore = 1;
-				table[errorPage].frame = errorPage;
-				
-				// set table in MMU
-				rc = USLOSS_MmuSetPageTable(table);
+				USLOSS_PTE pte = table[errorPage];
+				pte.read = 1;
+				pte.write = 1;
+				pte.incore = 1;
+				pte.frame = errorPage;
+				rc = P3PageTableUpdate(pid, errorPage, &pte);
+				assert(rc == P1_SUCCESS);
 			}
+
+			// set table in MMU, the update may have moved the process off the sentinel
+			rc = P3PageTableGet(pid, &table);
+			assert(rc == P1_SUCCESS);
+			rc = USLOSS_MmuSetPageTable(table);
 		}
 	}
 	else {
@@ -74,8 +79,8 @@ P3PageTableAllocateEmpty(int pages)
     USLOSS_PTE  *table = NULL;
 	int i;
 
-	// allocates memory for each page
-	table = malloc(sizeof(USLOSS_PTE) * pages);
+	// allocates memory for each page from the VM arena
+	table = P3SlabAlloc(P3_SLAB_PAGE_TABLE);
 	for (i = 0; i < pages; i++){
 		
 		// sets each page's initial values
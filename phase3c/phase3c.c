@@ -37,12 +37,104 @@ struct FaultList *head;
 
 int numPagers = 0;
 int pagerPids[P3_MAX_PAGERS];
+int pagersDoneSid;
+int faultSids[P1_MAXPROC];
+
+// load control
+struct FaultList *parked;       // faults of suspended processes
+int *residentPages[P1_MAXPROC]; // pages a suspended process had in frames, room for every frame
+int residentCount[P1_MAXPROC];
+int suspended[P1_MAXPROC];      // order in which a process was suspended, 0 if it isn't
+int suspendSeq;
+int loadPid;
+int intervalFaults;             // # of faults since load control last looked
+int pagerBusy;                  // usecs spent by pagers handling faults since then
+
+P3_PagerOptions P3_pagerOptions = {
+	.loadControl = 0,
+	.loadInterval = 1,
+	.thrashFaults = 20,
+	.thrashBusy = 50,
+	.readahead = 0,
+	.readaheadMax = 4,
+	.faultAround = 0,
+	.faultAroundReserve = 1,
+	.profile = NULL,
+	.profilePages = 32,
+	.profileBatch = 8,
+	.asyncSwap = 0,
+};
+P3_PagerStats	P3_pagerStats;
+
+// sequential fault detection for readahead
+typedef struct Stream {
+	int lastPage;	// page of the process's previous fault
+	int stride;		// distance between its last two faults
+	int run;		// # of consecutive faults with that stride
+	int window;		// # of pages to read ahead
+} Stream;
+
+Stream streams[P1_MAXPROC];
+
+// fault-around block size of each process, in pages
+int faultAround[P1_MAXPROC];
+
+// Fault profiles. The first pages a process faults on are recorded under its name, and the
+// next time a process with that name is spawned the pagers prefetch them. The profiles are
+// loaded from P3_pagerOptions.profile when the pagers start and saved there when they stop.
+
+#define PROFILES		16		// # of names with a profile
+#define PROFILE_PAGES	64		// most pages recorded per name
+
+typedef struct Profile {
+	char	name[P1_MAXNAME+1];
+	int		count;
+	int		pages[PROFILE_PAGES];
+} Profile;
+
+Profile profiles[PROFILES];
+int numProfiles;
+
+// what is being recorded for each process
+typedef struct Recording {
+	int		active;			// recording faults
+	int		profiled;		// a profile was prefetched when it was spawned
+	int		spawn;			// spawn #, so stale prefetches are ignored
+	int		start;			// time it was spawned
+	int		faults;			// # of faults it has taken
+	Profile	profile;
+	int		prefetch[PROFILE_PAGES];	// the profile it was spawned with, read by its prefetch jobs
+} Recording;
+
+Recording recordings[P1_MAXPROC];
+int spawns;
 
 
 
 //
 
 static int Pager(void *ptr);
+static int LoadControl(void *arg);
+static void Prepage(PID pid);
+static void Readahead(PID pid, int page);
+static void ReadaheadCheck(PID pid);
+static void StreamReset(PID pid);
+static int FrameTake(PID pid, int page, int reserve);
+static void FrameZero(int frame);
+static void FrameRelease(int frame);
+static void FrameWake(void);
+static int PidPin(PID pid);
+static void PidUnpin(PID pid);
+static int PageMapPinned(PID pid, int life, int page, int frame);
+static void FrameReturn(int frame);
+static void FaultAround(PID pid, int page);
+static void PageMap(PID pid, int page, int frame);
+static void TableLoad(PID pid);
+static int PageIncore(PID pid, int page);
+static void ProfileRecord(PID pid, int page);
+static void ProfileFinish(PID pid);
+static void ProfileLoad(char *path);
+static void ProfileSave(char *path);
 
 void debug3(char *fmt, ...)
 {
@@ -78,12 +170,53 @@ void kernelMode(void){
  *----------------------------------------------------------------------
  */
 
-struct Frame {
-	int pid;
-	int page;
-};
-
-struct Frame *frameTable;
+P3_Frames P3_frames;
+
+// Each process's frames are on an intrusive, doubly-linked list through frameNext and
+// framePrev, so freeing them takes time proportional to how many it has. Free frames are
+// on the list at FREE_FRAMES, so taking one doesn't scan the frames either.
+#define FREE_FRAMES P1_MAXPROC
+#define FrameList(pid) ((pid) == -1 ? FREE_FRAMES : (pid))
+
+static int *frameNext;
+static int *framePrev;
+static int frameLists[P1_MAXPROC + 1];	// first frame on each list, -1 if none
+
+// A pager that reads pages for a process outside of one of its faults, such as readahead,
+// pins the process. P3FrameFreeAll bumps a quitting process's life and waits until it isn't
+// pinned, so the process's page table is still there when the pager maps the pages, and the
+// pager can tell from the life that the process quit during a read and give the frame back.
+static int lives[P1_MAXPROC];
+static int pins[P1_MAXPROC];
+static int unpinWaiters;	// # of processes waiting in P3FrameFreeAll for a pid to be unpinned
+static SID unpinned;		// V'ed for each of them when a pid's last pin goes away
+
+// A process that maps frames with P3FrameMap, such as a pager, gets a flat page table of
+// its own whose top WINDOW_PAGES pages are windows onto frames, so mapping or unmapping
+// a frame writes one PTE instead of searching the process's page table for an unused
+// page. The processes that map frames are daemons that don't use the VM region. Phase 1
+// reinstalls a process's own page table when it is dispatched, so FaultHandler puts the
+// window table back the first time the process touches a window after that.
+//
+// Reloading the table is deferred. Unmapping a window only clears its PTE and leaves the
+// MMU mapping it until the next reload, and mapping a frame to a window the MMU still
+// maps to that frame, such as a victim's frame that is copied out and then filled, needs
+// no reload at all. So most faults reload the window table once, not once per edit.
+#define WINDOW_PAGES 4
+
+typedef struct Window {
+	USLOSS_PTE	*table;					// NULL until the process first maps a frame
+	int			frames[WINDOW_PAGES];	// frame in each window, -1 if none
+	int			loaded[WINDOW_PAGES];	// frame the MMU maps at each window, -1 if none
+} Window;
+
+static Window windows[P1_MAXPROC];
+static int windowPages;		// # of windows, fewer than WINDOW_PAGES if the region is small
+static int windowFirst;		// page of the first window
+static char *windowRegion;	// start of the VM region
+
+static void WindowFree(PID pid);
+static void WindowLoad(Window *window);
 
 int
 P3FrameInit(int pages, int frames)
@@ -99,15 +232,52 @@ P3FrameInit(int pages, int frames)
     isInit = 1;
 
 	// initialize the frame data structures, e.g. the pool of free frames
-	frameTable = malloc(sizeof(struct Frame) *frames);
-	for (i = 0; i < frames; i++){
-		frameTable[i].pid = -1;
-		frameTable[i].page = -1;
+	P3_frames.pid = P3ArenaAlloc(sizeof(PID) * frames);
+	P3_frames.page = P3ArenaAlloc(sizeof(int) * frames);
+	P3_frames.flags = P3ArenaAlloc(frames);
+	P3_frames.age = P3ArenaAlloc(frames);
+	P3_frames.slot = P3ArenaAlloc(sizeof(int) * frames);
+	frameNext = P3ArenaAlloc(sizeof(int) * frames);
+	framePrev = P3ArenaAlloc(sizeof(int) * frames);
+	for (i = 0; i <= FREE_FRAMES; i++){
+		frameLists[i] = -1;
+	}
+	// a suspended process's resident pages are kept in the arena, so quitting doesn't free them
+	int *resident = P3ArenaAlloc(sizeof(int) * frames * P1_MAXPROC);
+	for (i = 0; i < P1_MAXPROC; i++){
+		windows[i].table = NULL;
+		lives[i] = 0;
+		pins[i] = 0;
+		residentPages[i] = resident + i * frames;
+		residentCount[i] = 0;
+	}
+	int regionPages;
+	windowRegion = USLOSS_MmuRegion(&regionPages);
+	windowPages = pages < WINDOW_PAGES ? pages : WINDOW_PAGES;
+	windowFirst = pages - windowPages;
+	for (i = frames - 1; i >= 0; i--){
+		P3_frames.pid[i] = -1;
+		P3_frames.page[i] = -1;
+		P3_frames.slot[i] = -1;
+		framePrev[i] = -1;
+		frameNext[i] = frameLists[FREE_FRAMES];
+		if (frameNext[i] != -1){
+			framePrev[frameNext[i]] = i;
+		}
+		frameLists[FREE_FRAMES] = i;
 	}
 	
 	// creates a semaphore for freeFrames so that two pagers cannot access it at the same time.
-	rc = P1_SemCreate("freeFrames", 0, &freeFramesSid);
+	// it protects the frame descriptors too
+	rc = P1_SemCreate("freeFrames", 1, &freeFramesSid);
 	assert(rc == P1_SUCCESS);
+	P3_frames.sem = freeFramesSid;
+	rc = P1_SemCreate("frameIdle", 0, &P3_frames.idle);
+	assert(rc == P1_SUCCESS);
+	P3_frames.waiters = 0;
+	rc = P1_SemCreate("unpinned", 0, &unpinned);
+	assert(rc == P1_SUCCESS);
+	unpinWaiters = 0;
 
 	// sets values of P3_VmStats
 	P3_vmStats.frames = frames;
@@ -137,8 +307,15 @@ P3FrameShutdown(void)
 		return P3_NOT_INITIALIZED;
 	}
 
-	free(frameTable);
-	frameTable = NULL;
+	// the frame descriptors go with the VM arena
+	rc = P1_SemFree(P3_frames.idle);
+	assert(rc == P1_SUCCESS);
+	rc = P1_SemFree(unpinned);
+	assert(rc == P1_SUCCESS);
+	memset(&P3_frames, 0, sizeof(P3_frames));
+	for (i = 0; i < P1_MAXPROC; i++){
+		WindowFree(i);
+	}
 
 	rc = P1_SemFree(freeFramesSid);
 	assert(rc == P1_SUCCESS);
@@ -171,23 +348,40 @@ P3FrameFreeAll(int pid)
     if (pid < 0 || pid >= P1_MAXPROC)
         return P1_INVALID_PID;
 
-	// get the page table
-	USLOSS_PTE **pageTable = NULL;
-	rc = P3PageTableGet(pid, pageTable);
-	assert(rc == P1_SUCCESS);
+	// a process that quits is no longer suspended
+	suspended[pid] = 0;
+	residentCount[pid] = 0;
+	StreamReset(pid);
+	faultAround[pid] = P3_pagerOptions.faultAround;
+	ProfileFinish(pid);
+	WindowFree(pid);
 
-	i = 0;
+	// pagers reading pages for the process see that it is quitting and give the frames back
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	lives[pid]++;
+	while (pins[pid] > 0){
+		unpinWaiters++;
+		rc = P1_V(freeFramesSid);
+		assert(rc == P1_SUCCESS);
+		rc = P1_P(unpinned);
+		assert(rc == P1_SUCCESS);
+		rc = P1_P(freeFramesSid);
+		assert(rc == P1_SUCCESS);
+	}
 
-	// iterate over all pages in the page table
-	for (i = 0; i < pageSize; i++){
-		
-		// if the page has a frame, remove the frame and free it in frameTable
-		if(pageTable[i]->incore == 1) {
-			pageTable[i]->incore = 0;
-			frameTable[pageTable[i]->frame].pid = -1;
-			frameTable[pageTable[i]->frame].page = -1;
+	// the process's frames go back to the pool, its page table is freed after this. A busy
+	// frame is a victim that a pager is evicting, and that pager gives it to its new owner.
+	int frame = frameLists[pid];
+	while (frame != -1){
+		int next = frameNext[frame];
+		if (!(P3_frames.flags[frame] & P3_FRAME_BUSY)){
+			FrameRelease(frame);
 		}
+		frame = next;
 	}
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
 
     return P1_SUCCESS;
 }
@@ -197,11 +391,12 @@ P3FrameFreeAll(int pid)
  *
  * P3FrameMap --
  *
- *  Maps a frame to an unused page and returns a pointer to it.
+ *  Maps a frame to one of the caller's window pages and returns a
+ *  pointer to it.
  *
  * Results:
  *   P3_NOT_INITIALIZED:    P3FrameInit has not been called
- *   P3_OUT_OF_PAGES:       process has no free pages
+ *   P3_OUT_OF_PAGES:       process has no free window pages
  *   P1_INVALID_FRAME       the frame number is invalid
  *   P1_SUCCESS:            success
  *
@@ -215,44 +410,47 @@ P3FrameMap(int frame, void **ptr)
 		return P3_NOT_INITIALIZED;
 	}
 
-	if (frame < 0 || frame > P3_vmStats.frames) {
+	if (frame < 0 || frame >= P3_vmStats.frames) {
 		return P3_INVALID_FRAME;
 	}
 
-	// get the page table for the process (P3PageTableGet)
-	USLOSS_PTE *pageTable;
-	int pid = P1_GetPid();
-	rc = P3PageTableGet(pid, &pageTable);
-	assert(rc == P1_SUCCESS);
-
-	int flag = 0;
+	Window *window = &windows[P1_GetPid()];
+	if (window->table == NULL){
+		window->table = P3SlabAlloc(P3_SLAB_PAGE_TABLE);
+		memset(window->table, 0, sizeof(USLOSS_PTE) * P3_vmStats.pages);
+		for (int w = 0; w < WINDOW_PAGES; w++){
+			window->frames[w] = -1;
+			window->loaded[w] = -1;
+		}
+	}
 
-	for (i = 0; i < pageSize; i++) {
-		
-		// update the page's PTE to map the page to the frame
-		if (pageTable->incore == 0) {
-			flag = 1;
-			pageTable->incore = 1;
-			pageTable->frame = frame;
-			break;
+	// prefer a free window the MMU still maps to the frame
+	int w = -1;
+	for (int k = 0; k < windowPages; k++){
+		if (window->frames[k] == -1 && (w == -1 || window->loaded[k] == frame)){
+			w = k;
 		}
 	}
-	
-	if (flag == 0){
+	if (w == -1){
 		return P3_OUT_OF_PAGES;
 	}
-	
-	rc = USLOSS_MmuSetPageTable(pageTable);
-	assert(rc == USLOSS_MMU_OK);
-	// update the page table in the MMU (USLOSS_MmuSetPageTable)
-	
-    int numPages;
-	void *VMaddress;
-	VMaddress = USLOSS_MmuRegion(&numPages);
 
-	*ptr = VMaddress + (sizeof(USLOSS_PTE) * i);
-//	ptr = &(VMaddress + (sizeof(USLOSS_PTE) * i));
+	// update the window's PTE to map it to the frame
+	USLOSS_PTE *pte = &window->table[windowFirst + w];
+	pte->incore = 1;
+	pte->read = 1;
+	pte->write = 1;
+	pte->frame = frame;
+	window->frames[w] = frame;
+
+	if (window->loaded[w] == frame){
+		P3_pagerStats.reloadsSkipped++;
+	}
+	else {
+		WindowLoad(window);
+	}
 
+	*ptr = windowRegion + (windowFirst + w) * USLOSS_MmuPageSize();
     return P1_SUCCESS;
 }
 /*
@@ -278,41 +476,53 @@ P3FrameUnmap(int frame)
 		return P3_NOT_INITIALIZED;
 	}
 
-	if (frame < 0 || frame > P3_vmStats.frames) {
+	if (frame < 0 || frame >= P3_vmStats.frames) {
 		return P3_INVALID_FRAME;
 	}
 
-	// get the page table for the process (P3PageTableGet)
-	USLOSS_PTE **pageTable = NULL;
-
-	int pid = P1_GetPid();
-	rc = P3PageTableGet(pid, pageTable);
-	assert(rc == P1_SUCCESS);
-
-	int flag = 0;
-
-	for (i = 0; i < pageSize; i++) {
-		
-		// update the page's PTE to unmap the page to the frame
-		if (pageTable[i]->incore == 1 && pageTable[i]->frame == frame) {
-			flag = 1;
-			pageTable[i]->incore = 0;
-			pageTable[i]->frame = -1;
-			break;
-		}
+	Window *window = &windows[P1_GetPid()];
+	int w = 0;
+	while (window->table != NULL && w < windowPages && window->frames[w] != frame){
+		w++;
 	}
-	
-	if (flag == 0){
+	if (window->table == NULL || w == windowPages){
 		return P3_FRAME_NOT_MAPPED;
 	}
 
-	//update page table in MMU
-	rc = USLOSS_MmuSetPageTable(*pageTable);
-	assert(rc == USLOSS_MMU_OK);
+	// update the window's PTE to unmap it, the MMU keeps it until the next reload
+	window->table[windowFirst + w].incore = 0;
+	window->frames[w] = -1;
+	P3_pagerStats.reloadsSkipped++;
 
     return P1_SUCCESS;
 }
 
+/*
+ * Frees a process's window table, if it has one.
+ */
+static void
+WindowFree(PID pid)
+{
+	if (windows[pid].table != NULL){
+		P3SlabFree(P3_SLAB_PAGE_TABLE, windows[pid].table);
+		windows[pid].table = NULL;
+	}
+}
+
+/*
+ * Installs a window table in the MMU.
+ */
+static void
+WindowLoad(Window *window)
+{
+	rc = USLOSS_MmuSetPageTable(window->table);
+	assert(rc == USLOSS_MMU_OK);
+	for (int w = 0; w < WINDOW_PAGES; w++){
+		window->loaded[w] = window->frames[w];
+	}
+	P3_pagerStats.tableReloads++;
+}
+
 // information about a fault. Add to this as necessary.
 
 typedef struct Fault {
@@ -321,6 +531,9 @@ typedef struct Fault {
     int         cause;
     SID         wait;
 	int 		outOfSwap;
+	int			*prefetch;	// pages to prefetch in the process's Recording, NULL for a real fault
+	int			count;		// # of pages in prefetch
+	int			spawn;		// spawn # of the process the pages are for
     // other stuff goes here
 } Fault;
 
@@ -329,6 +542,39 @@ struct FaultList {
 	struct FaultList *next;
 };
 
+static void Prefetch(Fault *job);
+
+/*
+ * Adds a fault to the end of a fault list. Caller must hold faultListSid.
+ */
+static void
+FaultAppend(struct FaultList **list, struct FaultList *node)
+{
+	node->next = NULL;
+	if (*list == NULL){
+		*list = node;
+	}
+	else {
+		struct FaultList *curr = *list;
+		while (curr->next != NULL){
+			curr = curr->next;		
+		}
+		curr->next = node;
+	}
+}
+
+/*
+ * Returns the time in microseconds.
+ */
+static int
+Now(void)
+{
+	int now;
+	rc = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &now);
+	assert(rc == USLOSS_DEV_OK);
+	return now;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -349,33 +595,61 @@ FaultHandler(int type, void *arg)
     fault.offset = (int) arg;
 	fault.pid = P1_GetPid();
 	fault.cause = USLOSS_MmuGetCause();
-	fault.wait = faultListSid; 
+	fault.wait = faultSids[fault.pid]; 
 	fault.outOfSwap = 0;
+	fault.prefetch = NULL;
+
+	// a process that maps frames faults on a window after it is dispatched with its own
+	// page table installed
+	int faultPage = fault.offset / USLOSS_MmuPageSize();
+	Window *window = &windows[fault.pid];
+	if (fault.cause == USLOSS_MMU_FAULT && window->table != NULL && faultPage >= windowFirst &&
+		window->table[faultPage].incore){
+		WindowLoad(window);
+		return;
+	}
+
+	// in inverted mode a process is dispatched with the sentinel installed, so it faults
+	// once on a page its own table already maps
+	if (fault.cause == USLOSS_MMU_FAULT){
+		USLOSS_PTE pte;
+		rc = P3PageTableLookup(fault.pid, faultPage, &pte);
+		if (rc == P1_SUCCESS && pte.incore){
+			TableLoad(fault.pid);
+			return;
+		}
+	}
 
-	struct FaultList *newFault = (struct FaultList*) malloc(sizeof(struct FaultList));
+	struct FaultList *newFault = P3SlabAlloc(P3_SLAB_FAULT);
 	newFault->fault = fault;
 	
     // add to queue of pending faults
 	rc = P1_P(faultListSid);
 	assert(rc == P1_SUCCESS);
 
-	if (head == NULL){
-		head = newFault;
-	}
-	else {
-		struct FaultList *curr = head;
-		while (curr->next != NULL){
-			curr = curr->next;		
-		}
-		curr->next = newFault;
-	}
+	FaultAppend(&head, newFault);
+
 	rc = P1_V(faultListSid);
 	assert(rc == P1_SUCCESS);
+
+	rc = P1_P(pagersStatsSid);
+	assert(rc == P1_SUCCESS);
+	P3_vmStats.faults++;
+	intervalFaults++;
+	rc = P1_V(pagersStatsSid);
+	assert(rc == P1_SUCCESS);
+
     // let pagers know there is a pending fault and wait
 	rc = P1_V(emptyFaultSid);
 	assert(rc == P1_SUCCESS);
+
+	rc = P1_P(fault.wait);
+	assert(rc == P1_SUCCESS);
+
+	fault = newFault->fault;
+	P3SlabFree(P3_SLAB_FAULT, newFault);
+	TableLoad(fault.pid);
 	
-	//TODO fix the syntax
 	if (fault.cause == USLOSS_MMU_ACCESS){
 		P2_Terminate(USLOSS_MMU_ACCESS);
 	}
@@ -416,9 +690,32 @@ P3PagerInit(int pages, int frames, int pagers)
 	
 	// initialize the pager data structure
 	head = NULL;
+	parked = NULL;
+	intervalFaults = 0;
+	pagerBusy = 0;
+	suspendSeq = 0;
+	memset(suspended, 0, sizeof(suspended));
+	memset(&P3_pagerStats, 0, sizeof(P3_pagerStats));
+	for (i = 0; i < P1_MAXPROC; i++){
+		StreamReset(i);
+		faultAround[i] = P3_pagerOptions.faultAround;
+		recordings[i].active = 0;
+	}
+	numProfiles = 0;
+	if (P3_pagerOptions.profile != NULL){
+		ProfileLoad(P3_pagerOptions.profile);
+	}
 
     USLOSS_IntVec[USLOSS_MMU_INT] = FaultHandler;
 
+	// a fault record for each process that can be waiting on a fault
+	rc = P3SlabInit(P3_SLAB_FAULT, sizeof(struct FaultList), P1_MAXPROC);
+	assert(rc == P1_SUCCESS);
+
+	// readahead, suspending and prepaging each list at most a page per frame, three at once
+	rc = P3SlabInit(P3_SLAB_FRAME_LIST, sizeof(int) * frames, P3_MAX_PAGERS * 3);
+	assert(rc == P1_SUCCESS);
+
 	// creates semaphore for faultList
 	rc = P1_SemCreate("faultList", 1, &faultListSid);
 	assert(rc == P1_SUCCESS);
@@ -431,6 +728,18 @@ P3PagerInit(int pages, int frames, int pagers)
 	rc = P1_SemCreate("emptyFault", 0, &emptyFaultSid);
 	assert(rc == P1_SUCCESS);
 
+	// creates semaphore the pagers signal when they quit
+	rc = P1_SemCreate("pagersDone", 0, &pagersDoneSid);
+	assert(rc == P1_SUCCESS);
+
+	// creates a semaphore for each process to wait on while its fault is handled
+	for (i = 0; i < P1_MAXPROC; i++){
+		char name[P1_MAXNAME+1];
+		snprintf(name, sizeof(name), "fault%d", i);
+		rc = P1_SemCreate(name, 0, &faultSids[i]);
+		assert(rc == P1_SUCCESS);
+	}
+
 	// forks off the pagers
 	for (i = 0; i < pagers; i++){
 		numPagers++;
@@ -440,6 +749,12 @@ P3PagerInit(int pages, int frames, int pagers)
 		assert(rc == P1_SUCCESS);
 	}
 
+	// forks off load control, it runs at the pager priority so it isn't starved by thrashing
+	if (P3_pagerOptions.loadControl){
+		rc = P1_Fork("loadControl", LoadControl, NULL, USLOSS_MIN_STACK, P3_PAGER_PRIORITY, 0, &loadPid);
+		assert(rc == P1_SUCCESS);
+	}
+
     return P1_SUCCESS;
 }
 
@@ -464,17 +779,36 @@ P3PagerShutdown(void)
 		return P3_NOT_INITIALIZED;
 	}
 	
+    // cause the pagers to quit and wait for them
+	int pagers = numPagers;
+	numPagers = 0;
+	for (i = 0; i < pagers; i++){
+		rc = P1_V(emptyFaultSid);
+		assert(rc == P1_SUCCESS);
+	}
+	if (P3_pagerOptions.loadControl){
+		pagers++;
+	}
+	for (i = 0; i < pagers; i++){
+		rc = P1_P(pagersDoneSid);
+		assert(rc == P1_SUCCESS);
+	}
+
     // clean up the pager data structures
 	struct FaultList *curr = head;
 	while (curr != NULL){
 		struct FaultList *next = curr->next;
-		free(curr);
+		P3SlabFree(P3_SLAB_FAULT, curr);
 		curr = next;
 	}
-
-	//TODO:
-    // cause the pagers to quit
-	numPagers = 0;
+	head = NULL;
+	curr = parked;
+	while (curr != NULL){
+		struct FaultList *next = curr->next;
+		P3SlabFree(P3_SLAB_FAULT, curr);
+		curr = next;
+	}
+	parked = NULL;
 
 	// free the semaphores created in PagerInit
 	rc = P1_SemFree(faultListSid);
@@ -486,7 +820,43 @@ P3PagerShutdown(void)
 	rc = P1_SemFree(emptyFaultSid);
 	assert(rc == P1_SUCCESS);
 
+	rc = P1_SemFree(pagersDoneSid);
+	assert(rc == P1_SUCCESS);
+
+	for (i = 0; i < P1_MAXPROC; i++){
+		rc = P1_SemFree(faultSids[i]);
+		assert(rc == P1_SUCCESS);
+	}
 
+	if (P3_pagerOptions.profile != NULL){
+		ProfileSave(P3_pagerOptions.profile);
+		USLOSS_Console("P3PagerShutdown: profiled spawns: %d, prefetched: %d, profiles saved: %d\n",
+			P3_pagerStats.profileSpawns, P3_pagerStats.profilePrefetches, P3_pagerStats.profileSaves);
+		USLOSS_Console("P3PagerShutdown: with profile: %d runs, %d faults, %d usecs, "
+			"without: %d runs, %d faults, %d usecs\n",
+			P3_pagerStats.profiledRuns, P3_pagerStats.profiledFaults, P3_pagerStats.profiledUsecs,
+			P3_pagerStats.unprofiledRuns, P3_pagerStats.unprofiledFaults, P3_pagerStats.unprofiledUsecs);
+	}
+	if (P3_pagerOptions.faultAround > 1){
+		USLOSS_Console("P3PagerShutdown: fault-around pages: %d\n", P3_pagerStats.faultArounds);
+	}
+	if (P3_vmStats.faults > 0){
+		USLOSS_Console("P3PagerShutdown: table reloads: %d (%d.%02d per fault), skipped: %d\n",
+			P3_pagerStats.tableReloads, P3_pagerStats.tableReloads / P3_vmStats.faults,
+			(P3_pagerStats.tableReloads * 100 / P3_vmStats.faults) % 100, P3_pagerStats.reloadsSkipped);
+	}
+	if (P3_pagerOptions.asyncSwap){
+		USLOSS_Console("P3PagerShutdown: overlapped swap I/Os: %d\n", P3_pagerStats.overlapped);
+	}
+	if (P3_pagerOptions.readahead){
+		USLOSS_Console("P3PagerShutdown: readaheads: %d, hits: %d, misses: %d\n",
+			P3_pagerStats.readaheads, P3_pagerStats.readaheadHits, P3_pagerStats.readaheadMisses);
+	}
+	if (P3_pagerOptions.loadControl){
+		USLOSS_Console("P3PagerShutdown: suspends: %d, resumes: %d, frames taken: %d, prepaged: %d\n",
+			P3_pagerStats.suspends, P3_pagerStats.resumes, P3_pagerStats.suspendFrames,
+			P3_pagerStats.prepaged);
+	}
 
     return P1_SUCCESS;
 }
@@ -494,101 +864,1189 @@ P3PagerShutdown(void)
 /*
  *----------------------------------------------------------------------
  *
- * Pager --
+ * Suspend --
  *
- *  Handles page faults
+ *  Suspends the lowest-priority process that has frames and gives all
+ *  of its frames back to the free pool. The process's faults are parked
+ *  until it is resumed, so it stops running as soon as it touches its
+ *  VM region.
  *
  *----------------------------------------------------------------------
  */
-
-static int
-Pager(void *arg)
+static void
+Suspend(void)
 {
-	kernelMode();
-
-	// notify P3PagerInit that we are running
-	while (numPagers){
-		
-		// will pause here until there exists a fault
-		rc = P1_P(emptyFaultSid);
-		assert(rc == P1_SUCCESS);
-		
-		// locks fault list
-		rc = P1_P(faultListSid);
-		assert(rc == P1_SUCCESS);
+	int owned[P1_MAXPROC] = {0};
+	int victim = -1;
+	int lowest = -1;
 
-		// grabs first fault
-		struct Fault currFault = head->fault;
-		head = head->next;
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	for (int f = 0; f < P3_vmStats.frames; f++){
+		if (P3_frames.pid[f] != -1){
+			owned[P3_frames.pid[f]]++;
+		}
+	}
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
 
-		
-		// unlocks fault list
-		rc = P1_V(faultListSid);
-		assert(rc == P1_SUCCESS);
-		
-		if (currFault.cause == USLOSS_MMU_ACCESS) {
-			continue;	
+	// larger numbers are lower priorities
+	for (int pid = 0; pid < P1_MAXPROC; pid++){
+		P1_ProcInfo info;
+		if (owned[pid] == 0 || suspended[pid]){
+			continue;
+		}
+		rc = P1_GetProcInfo(pid, &info);
+		if (rc == P1_SUCCESS && info.priority > lowest){
+			lowest = info.priority;
+			victim = pid;
 		}
+	}
+	if (victim == -1){
+		return;
+	}
 
+	rc = P1_P(faultListSid);
+	assert(rc == P1_SUCCESS);
+	suspended[victim] = ++suspendSeq;
+	rc = P1_V(faultListSid);
+	assert(rc == P1_SUCCESS);
 
-		//TODO: semaphores for freeframe and maybe more?
-		int currFrame;
-		if (P3_vmStats.freeFrames > 0){
+	int *frames = P3SlabAlloc(P3_SLAB_FRAME_LIST);
+	int count;
+	rc = P3SwapOutProcess(victim, frames, &count);
+	assert(rc == P1_SUCCESS);
 
-            rc = P1_P(freeFramesSid);
-            assert(rc == P1_SUCCESS);
-            P3_vmStats.freeFrames -= 1;
-            rc = P1_V(freeFramesSid);
-            assert(rc == P1_SUCCESS);
-			for (i = 0; i < P3_vmStats.frames; i++){
-				if (frameTable[i].pid == -1){
-					currFrame = i;
-				}
-			}
-		}
-		else {
-			rc = P3SwapOut(&currFrame);
-			assert(rc == P1_SUCCESS);
-		}
-	
-        int faultPage = currFault.offset / USLOSS_MmuPageSize();
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	// remember what was resident so Resume can bring it all back at once
+	residentCount[victim] = count;
+	for (int f = 0; f < count; f++){
+		residentPages[victim][f] = P3_frames.page[frames[f]];
+		FrameRelease(frames[f]);
+	}
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	P3SlabFree(P3_SLAB_FRAME_LIST, frames);
 
-		rc = P3SwapIn(currFault.pid, faultPage, currFrame);
+	P3_pagerStats.suspends++;
+	P3_pagerStats.suspendFrames += count;
+	debug3("Suspend: pid %d, %d frames\n", victim, count);
+}
 
-		struct USLOSS_PTE *addr;
-		if (rc == P3_EMPTY_PAGE){
-			rc = P3FrameMap(currFrame, (void**) &addr);
-			assert(rc == P1_SUCCESS);
+/*
+ *----------------------------------------------------------------------
+ *
+ * Resume --
+ *
+ *  Resumes the process that has been suspended the longest. The pages
+ *  it had in frames when it was suspended are prepaged first, then its
+ *  parked faults are moved back onto the fault queue.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+Resume(void)
+{
+	int victim = -1;
+	int moved = 0;
 
-			//zero-out frame at addr
-			addr->incore = 0;
-			addr->read = 0;
-			addr->write = 0;
-			addr->frame = 0;
-			rc = P3FrameUnmap(currFrame);
-			assert(rc == P1_SUCCESS);
+	for (int pid = 0; pid < P1_MAXPROC; pid++){
+		if (suspended[pid] && (victim == -1 || suspended[pid] < suspended[victim])){
+			victim = pid;
 		}
-		else if (rc == P3_OUT_OF_SWAP){
-			
-			//kill the faulting process
-			currFault.outOfSwap = 1; 
-			continue;
+	}
+	if (victim != -1){
+		Prepage(victim);
+	}
+
+	rc = P1_P(faultListSid);
+	assert(rc == P1_SUCCESS);
+
+	if (victim != -1){
+		suspended[victim] = 0;
+		struct FaultList **prev = &parked;
+		while (*prev != NULL){
+			struct FaultList *curr = *prev;
+			if (curr->fault.pid == victim){
+				*prev = curr->next;
+				FaultAppend(&head, curr);
+				moved++;
+			}
+			else {
+				prev = &curr->next;
+			}
 		}
+	}
 
-		//update PTE in faulting process's page table to map page to frame
-		addr->incore = 1;
-		addr->read = 1;
-		addr->write = 1;
-		addr->frame = currFrame;
+	rc = P1_V(faultListSid);
+	assert(rc == P1_SUCCESS);
 
-		// unblock faulting process
+	for (i = 0; i < moved; i++){
+		rc = P1_V(emptyFaultSid);
+		assert(rc == P1_SUCCESS);
+	}
+	if (victim != -1){
+		P3_pagerStats.resumes++;
+		debug3("Resume: pid %d\n", victim);
+	}
+}
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Prepage --
+ *
+ *  Brings back the pages a suspended process had in frames when it was
+ *  suspended, as far as there are free frames for them. P3SwapInBatch
+ *  reads them in disk order, several slots per read.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+Prepage(PID pid)
+{
+	int *pages = residentPages[pid];
+	int count = 0;
+
+	if (residentCount[pid] == 0){
+		return;
+	}
+
+	// pages that are incore, or all of them if the process has no page table, are skipped
+	int *frames = P3SlabAlloc(P3_SLAB_FRAME_LIST);
+	for (int n = 0; n < residentCount[pid]; n++){
+		if (PageIncore(pid, pages[n]) != 0){
+			continue;
+		}
+		frames[count] = FrameTake(pid, pages[n], 0);
+		if (frames[count] == -1){
+			break;
+		}
+		pages[count] = pages[n];
+		count++;
 	}
 
+	int *taken = P3SlabAlloc(P3_SLAB_FRAME_LIST);
+	memcpy(taken, frames, sizeof(int) * count);
+	if (count > 0){
+		rc = P3SwapInBatch(pid, pages, frames, count);
+		assert(rc == P1_SUCCESS);
+	}
 
+	for (int n = 0; n < count; n++){
+		if (frames[n] == -1){
+			continue;
+		}
+		rc = USLOSS_MmuSetAccess(frames[n], 0);
+		assert(rc == USLOSS_MMU_OK);
+		PageMap(pid, pages[n], frames[n]);
+		P3_pagerStats.prepaged++;
+	}
 
+	// frames for pages that weren't on the swap disk go back to the pool
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	for (int n = 0; n < count; n++){
+		if (frames[n] == -1){
+			FrameRelease(taken[n]);
+		}
+	}
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
 
+	P3SlabFree(P3_SLAB_FRAME_LIST, taken);
+	P3SlabFree(P3_SLAB_FRAME_LIST, frames);
+	residentCount[pid] = 0;
+}
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadControl --
+ *
+ *  Medium-term scheduler. Every loadInterval seconds it looks at the
+ *  number of faults and at how much of the interval the pagers spent
+ *  handling them. If both are high and there are no free frames the
+ *  system is thrashing and a process is suspended. Once the fault rate
+ *  has dropped to half the threshold a suspended process is resumed.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+LoadControl(void *arg)
+{
+	kernelMode();
+
+	while (1){
+		rc = P2_Sleep(P3_pagerOptions.loadInterval);
+		assert(rc == P1_SUCCESS);
+
+		if (!numPagers){
+			break;
+		}
+
+		rc = P1_P(pagersStatsSid);
+		assert(rc == P1_SUCCESS);
+		int faults = intervalFaults;
+		int busy = pagerBusy;
+		intervalFaults = 0;
+		pagerBusy = 0;
+		rc = P1_V(pagersStatsSid);
+		assert(rc == P1_SUCCESS);
+
+		// percentage of the interval the pagers were handling faults
+		int utilization = (int) ((long long) busy * 100 /
+			((long long) P3_pagerOptions.loadInterval * 1000000 * numPagers));
+
+		if (faults >= P3_pagerOptions.thrashFaults &&
+			utilization >= P3_pagerOptions.thrashBusy &&
+			P3_vmStats.freeFrames == 0){
+			Suspend();
+		}
+		else if (faults < P3_pagerOptions.thrashFaults / 2){
+			Resume();
+		}
+	}
+
+	rc = P1_V(pagersDoneSid);
+	assert(rc == P1_SUCCESS);
+	return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FrameTake --
+ *
+ *  Takes a free frame for the page, as long as more than reserve
+ *  frames are free. The frame is busy until PageMap maps the page
+ *  to it or it is released.
+ *
+ * Results:
+ *   The frame, or -1 if there weren't enough free frames.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+FrameTake(PID pid, int page, int reserve)
+{
+	int frame = -1;
+
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	if (P3_vmStats.freeFrames > reserve){
+		frame = frameLists[FREE_FRAMES];
+		assert(frame != -1);
+		P3_vmStats.freeFrames -= 1;
+		P3FrameOwnerSet(frame, pid, page);
+
+		// nobody may replace the frame until PageMap has mapped the page to it
+		P3_frames.flags[frame] = P3_FRAME_BUSY;
+	}
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	return frame;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3FrameOwnerSet --
+ *
+ *  Records that the frame holds the page of the process, moving it
+ *  from its old owner's list of frames to the new owner's. A pid of
+ *  -1 puts it on the list of free frames but doesn't count it as
+ *  free. Caller must hold P3_frames.sem.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+P3FrameOwnerSet(int frame, PID pid, int page)
+{
+	PID old = P3_frames.pid[frame];
+
+	if (old != pid){
+		if (framePrev[frame] != -1){
+			frameNext[framePrev[frame]] = frameNext[frame];
+		}
+		else {
+			frameLists[FrameList(old)] = frameNext[frame];
+		}
+		if (frameNext[frame] != -1){
+			framePrev[frameNext[frame]] = framePrev[frame];
+		}
+		framePrev[frame] = -1;
+		frameNext[frame] = frameLists[FrameList(pid)];
+		if (frameNext[frame] != -1){
+			framePrev[frameNext[frame]] = frame;
+		}
+		frameLists[FrameList(pid)] = frame;
+	}
+	P3_frames.pid[frame] = pid;
+	P3_frames.page[frame] = page;
+}
+
+/*
+ * Returns a frame to the pool of free frames. Caller must hold freeFramesSid.
+ */
+static void
+FrameRelease(int frame)
+{
+	P3FrameOwnerSet(frame, -1, -1);
+	P3_frames.flags[frame] = 0;
+	P3_frames.age[frame] = 0;
+	P3_frames.slot[frame] = -1;
+	P3_vmStats.freeFrames += 1;
+	FrameWake();
+}
+
+/*
+ * Wakes a process that is waiting for a frame that isn't busy, if there is one. Caller
+ * must hold freeFramesSid.
+ */
+static void
+FrameWake(void)
+{
+	if (P3_frames.waiters > 0){
+		P3_frames.waiters--;
+		rc = P1_V(P3_frames.idle);
+		assert(rc == P1_SUCCESS);
+	}
+}
+
+/*
+ * Pins a process so that its page table isn't freed until PidUnpin. Returns the process's
+ * life, which stays the same until the process starts to quit.
+ */
+static int
+PidPin(PID pid)
+{
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	pins[pid]++;
+	int life = lives[pid];
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	return life;
+}
+
+/*
+ * Undoes PidPin, letting P3FrameFreeAll go on if the process is quitting.
+ */
+static void
+PidUnpin(PID pid)
+{
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	pins[pid]--;
+	if (pins[pid] == 0){
+		while (unpinWaiters > 0){
+			unpinWaiters--;
+			rc = P1_V(unpinned);
+			assert(rc == P1_SUCCESS);
+		}
+	}
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Maps a page a pager read for a pinned process, or gives the frame back if the process
+ * started to quit since it was pinned. Returns TRUE if the page was mapped.
+ */
+static int
+PageMapPinned(PID pid, int life, int page, int frame)
+{
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	int alive = lives[pid] == life;
+	if (!alive){
+		FrameRelease(frame);
+	}
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	if (alive){
+		PageMap(pid, page, frame);
+	}
+	return alive;
+}
+
+/*
+ * Gives back a frame a pager took but didn't fill.
+ */
+static void
+FrameReturn(int frame)
+{
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	FrameRelease(frame);
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Fills a frame with zeros.
+ */
+static void
+FrameZero(int frame)
+{
+	void *addr;
+	rc = P3FrameMap(frame, &addr);
+	assert(rc == P1_SUCCESS);
+
+	//zero-out frame at addr
+	memset(addr, 0, USLOSS_MmuPageSize());
+	rc = P3FrameUnmap(frame);
+	assert(rc == P1_SUCCESS);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FaultAround --
+ *
+ *  Called when a process faults on a new page. The other untouched
+ *  pages in the same aligned block of faultAround[pid] pages are
+ *  zero-filled and mapped along with it, as long as more than
+ *  faultAroundReserve frames are free. A page is untouched if it isn't
+ *  in a frame and has no copy on the swap disk. Another pager can evict
+ *  the page between that check and the swap-in, in which case the page
+ *  is read instead of zero-filled. The caller maps the faulting page
+ *  itself.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+FaultAround(PID pid, int page)
+{
+	int block = faultAround[pid];
+	int first = (page / block) * block;
+
+	for (int p = first; p < first + block && p < P3_vmStats.pages; p++){
+		if (p == page || PageIncore(pid, p) || P3SwapCached(pid, p)){
+			continue;
+		}
+		int frame = FrameTake(pid, p, P3_pagerOptions.faultAroundReserve);
+		if (frame == -1){
+			break;
+		}
+		rc = P3SwapIn(pid, p, frame);
+		int empty = rc == P3_EMPTY_PAGE;
+		if (empty){
+			FrameZero(frame);
+		}
+		else if (rc != P1_SUCCESS){
+			FrameReturn(frame);
+			break;
+		}
+
+		// the pager touched the frame filling it, only the process's references count
+		rc = USLOSS_MmuSetAccess(frame, 0);
+		assert(rc == USLOSS_MMU_OK);
+
+		PageMap(pid, p, frame);
+		if (empty){
+			P3_vmStats.new++;
+			P3_pagerStats.faultArounds++;
+		}
+	}
+}
+
+/*
+ * Installs the process's page table in the MMU, after a fault may have moved it off the
+ * sentinel or, in inverted mode, when phase 1 dispatched it with the sentinel.
+ */
+static void
+TableLoad(PID pid)
+{
+	USLOSS_PTE *table;
+
+	rc = P3PageTableGet(pid, &table);
+	assert(rc == P1_SUCCESS);
+	if (table != NULL){
+		rc = USLOSS_MmuSetPageTable(table);
+		assert(rc == USLOSS_MMU_OK);
+		P3_pagerStats.tableReloads++;
+	}
+}
+
+/*
+ * Returns 1 if the page is incore in the process's page table, 0 if it isn't, and -1 if
+ * the process has no page table.
+ */
+static int
+PageIncore(PID pid, int page)
+{
+	USLOSS_PTE pte;
+
+	if (P3PageTableLookup(pid, page, &pte) != P1_SUCCESS){
+		return -1;
+	}
+	return pte.incore;
+}
+
+/*
+ * Maps the page to the frame in the process's page table. The frame was busy since it
+ * was taken or chosen as a victim, it can be replaced once the page is mapped.
+ */
+static void
+PageMap(PID pid, int page, int frame)
+{
+	USLOSS_PTE pte;
+
+	pte.incore = 1;
+	pte.read = 1;
+	pte.write = 1;
+	pte.frame = frame;
+	rc = P3PageTableUpdate(pid, page, &pte);
+	assert(rc == P1_SUCCESS);
+
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	P3_frames.flags[frame] &= ~P3_FRAME_BUSY;
+	FrameWake();
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3PagerSetFaultAround --
+ *
+ *  Sets the size of a process's fault-around block, in pages. A size
+ *  of 0 or 1 turns fault-around off for the process. The size goes
+ *  back to P3_pagerOptions.faultAround when the process quits.
+ *
+ * Results:
+ *   P1_INVALID_PID:         the pid is invalid
+ *   P3_INVALID_NUM_PAGES:   the size is invalid
+ *   P1_SUCCESS:             success
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3PagerSetFaultAround(PID pid, int pages)
+{
+	kernelMode();
+
+	if (pid < 0 || pid >= P1_MAXPROC){
+		return P1_INVALID_PID;
+	}
+	if (pages < 0 || pages > P3_vmStats.pages){
+		return P3_INVALID_NUM_PAGES;
+	}
+	faultAround[pid] = pages;
+	return P1_SUCCESS;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3PagerSpawn --
+ *
+ *  Called by P3_AllocatePageTable when a process is spawned. Starts
+ *  recording the process's faults and, if there is a profile for its
+ *  name, queues the profile's pages for the pagers to prefetch in
+ *  batches of profileBatch pages. The batches go through the fault
+ *  queue so real faults aren't stuck behind the whole profile.
+ *
+ * Results:
+ *   P1_INVALID_PID:         the pid is invalid
+ *   P1_SUCCESS:             success
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3PagerSpawn(PID pid)
+{
+	P1_ProcInfo info;
+
+	kernelMode();
+
+	if (pid < 0 || pid >= P1_MAXPROC){
+		return P1_INVALID_PID;
+	}
+	if (!isInitPager || P3_pagerOptions.profile == NULL){
+		return P1_SUCCESS;
+	}
+	rc = P1_GetProcInfo(pid, &info);
+	if (rc != P1_SUCCESS){
+		return P1_SUCCESS;
+	}
+
+	Recording *rec = &recordings[pid];
+	rec->active = 1;
+	rec->profiled = 0;
+	rec->spawn = ++spawns;
+	rec->start = Now();
+	rec->faults = 0;
+	snprintf(rec->profile.name, sizeof(rec->profile.name), "%s", info.name);
+	rec->profile.count = 0;
+
+	Profile *profile = NULL;
+	for (int n = 0; n < numProfiles; n++){
+		if (strcmp(profiles[n].name, info.name) == 0){
+			profile = &profiles[n];
+			break;
+		}
+	}
+	if (profile == NULL || profile->count == 0){
+		return P1_SUCCESS;
+	}
+	rec->profiled = 1;
+	P3_pagerStats.profileSpawns++;
+
+	// the jobs read the pages from the recording, the profile can be replaced while they wait
+	memcpy(rec->prefetch, profile->pages, sizeof(int) * profile->count);
+
+	int batch = P3_pagerOptions.profileBatch > 0 ? P3_pagerOptions.profileBatch : profile->count;
+	int jobs = 0;
+
+	rc = P1_P(faultListSid);
+	assert(rc == P1_SUCCESS);
+	for (int first = 0; first < profile->count; first += batch){
+		struct FaultList *job = P3SlabAlloc(P3_SLAB_FAULT);
+		job->fault.pid = pid;
+		job->fault.cause = USLOSS_MMU_FAULT;
+		job->fault.spawn = rec->spawn;
+		job->fault.count = profile->count - first < batch ? profile->count - first : batch;
+		job->fault.prefetch = rec->prefetch + first;
+		FaultAppend(&head, job);
+		jobs++;
+	}
+	rc = P1_V(faultListSid);
+	assert(rc == P1_SUCCESS);
+
+	for (int n = 0; n < jobs; n++){
+		rc = P1_V(emptyFaultSid);
+		assert(rc == P1_SUCCESS);
+	}
+	return P1_SUCCESS;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Prefetch --
+ *
+ *  Maps a batch of profiled pages for a process that was just spawned.
+ *  Only free frames are used. Pages that are on the swap disk are read,
+ *  the rest are zero-filled. The process runs meanwhile and may quit,
+ *  so it is pinned like it is for readahead.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+Prefetch(Fault *job)
+{
+	int life = PidPin(job->pid);
+
+	for (int n = 0; n < job->count; n++){
+		// the process may have quit and its pid been reused, the pages are its successor's then
+		if (!recordings[job->pid].active || recordings[job->pid].spawn != job->spawn){
+			break;
+		}
+		int page = job->prefetch[n];
+		if (page < 0 || page >= P3_vmStats.pages || PageIncore(job->pid, page) != 0){
+			continue;
+		}
+		int frame = FrameTake(job->pid, page, 0);
+		if (frame == -1){
+			break;
+		}
+		rc = P3SwapIn(job->pid, page, frame);
+		if (rc == P3_EMPTY_PAGE){
+			FrameZero(frame);
+		}
+		else if (rc != P1_SUCCESS){
+			FrameReturn(frame);
+			break;
+		}
+
+		// the pager touched the frame filling it, only the process's references count
+		rc = USLOSS_MmuSetAccess(frame, 0);
+		assert(rc == USLOSS_MMU_OK);
+
+		if (!PageMapPinned(job->pid, life, page, frame)){
+			break;
+		}
+		P3_pagerStats.profilePrefetches++;
+	}
+	PidUnpin(job->pid);
+}
+
+/*
+ * Counts a fault and records its page if it is one of the first profilePages distinct pages
+ * the process faulted on.
+ */
+static void
+ProfileRecord(PID pid, int page)
+{
+	Recording *rec = &recordings[pid];
+	int limit = P3_pagerOptions.profilePages < PROFILE_PAGES ? P3_pagerOptions.profilePages : PROFILE_PAGES;
+
+	rec->faults++;
+	if (rec->profile.count >= limit){
+		return;
+	}
+	for (int n = 0; n < rec->profile.count; n++){
+		if (rec->profile.pages[n] == page){
+			return;
+		}
+	}
+	rec->profile.pages[rec->profile.count++] = page;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProfileFinish --
+ *
+ *  Called when a process quits. Reports how many faults the process
+ *  took and how long it ran, with or without a profile. If it ran
+ *  without one its recording becomes the profile for its name,
+ *  replacing the oldest profile if the table is full.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+ProfileFinish(PID pid)
+{
+	Recording *rec = &recordings[pid];
+
+	if (!rec->active){
+		return;
+	}
+	rec->active = 0;
+
+	if (rec->profiled){
+		P3_pagerStats.profiledRuns++;
+		P3_pagerStats.profiledFaults += rec->faults;
+		P3_pagerStats.profiledUsecs += Now() - rec->start;
+	}
+	else {
+		P3_pagerStats.unprofiledRuns++;
+		P3_pagerStats.unprofiledFaults += rec->faults;
+		P3_pagerStats.unprofiledUsecs += Now() - rec->start;
+	}
+
+	if (rec->profiled || rec->profile.count == 0){
+		return;
+	}
+	int n;
+	for (n = 0; n < numProfiles; n++){
+		if (strcmp(profiles[n].name, rec->profile.name) == 0){
+			break;
+		}
+	}
+	if (n == numProfiles){
+		if (numProfiles < PROFILES){
+			numProfiles++;
+		}
+		else {
+			memmove(profiles, profiles + 1, sizeof(Profile) * (PROFILES - 1));
+			n = PROFILES - 1;
+		}
+	}
+	profiles[n] = rec->profile;
+	P3_pagerStats.profileSaves++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProfileLoad --
+ *
+ *  Reads the profiles from a file. Each profile is its name with its
+ *  terminating NUL, a one-byte page count, then the pages as two-byte
+ *  little-endian numbers. A missing file means there are no profiles.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+ProfileLoad(char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL){
+		return;
+	}
+	while (numProfiles < PROFILES){
+		Profile *profile = &profiles[numProfiles];
+		int c;
+		int len = 0;
+		while ((c = fgetc(f)) != EOF && c != '\0' && len < P1_MAXNAME){
+			profile->name[len++] = c;
+		}
+		profile->name[len] = '\0';
+		if (c != '\0'){
+			break;
+		}
+		if ((c = fgetc(f)) == EOF || c > PROFILE_PAGES){
+			break;
+		}
+		profile->count = c;
+		for (int n = 0; n < profile->count; n++){
+			int lo = fgetc(f);
+			int hi = fgetc(f);
+			if (hi == EOF){
+				profile->count = n;
+				break;
+			}
+			profile->pages[n] = lo | (hi << 8);
+		}
+		numProfiles++;
+	}
+	fclose(f);
+}
+
+/*
+ * Writes the profiles to a file in the format ProfileLoad reads.
+ */
+static void
+ProfileSave(char *path)
+{
+	FILE *f = fopen(path, "wb");
+	if (f == NULL){
+		USLOSS_Console("ProfileSave: can't open %s\n", path);
+		return;
+	}
+	for (int n = 0; n < numProfiles; n++){
+		fwrite(profiles[n].name, 1, strlen(profiles[n].name) + 1, f);
+		fputc(profiles[n].count, f);
+		for (int p = 0; p < profiles[n].count; p++){
+			fputc(profiles[n].pages[p] & 0xff, f);
+			fputc((profiles[n].pages[p] >> 8) & 0xff, f);
+		}
+	}
+	fclose(f);
+}
+
+/*
+ * Forgets a process's fault stream.
+ */
+static void
+StreamReset(PID pid)
+{
+	streams[pid].lastPage = -1;
+	streams[pid].stride = 0;
+	streams[pid].run = 0;
+	streams[pid].window = 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadaheadCheck --
+ *
+ *  Counts the process's readahead pages that have been referenced
+ *  since its last fault as hits and grows its readahead window.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+ReadaheadCheck(PID pid)
+{
+	int access;
+
+	// only the process's own frames can hold its readahead pages
+	rc = P1_P(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+	for (int f = frameLists[pid]; f != -1; f = frameNext[f]){
+		if (!(P3_frames.flags[f] & P3_FRAME_READAHEAD)){
+			continue;
+		}
+		rc = USLOSS_MmuGetAccess(f, &access);
+		assert(rc == USLOSS_MMU_OK);
+		if (access & USLOSS_MMU_REF){
+			P3_frames.flags[f] &= ~P3_FRAME_READAHEAD;
+			if (streams[pid].window < P3_pagerOptions.readaheadMax){
+				streams[pid].window++;
+			}
+			P3_pagerStats.readaheadHits++;
+		}
+	}
+	rc = P1_V(freeFramesSid);
+	assert(rc == P1_SUCCESS);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Readahead --
+ *
+ *  Records the fault in the process's stream. Once two faults in a row
+ *  are the same distance apart the stream is sequential, and the pages
+ *  that follow it in that direction are swapped in and mapped before
+ *  the process touches them. Only pages that have a copy on the swap
+ *  disk are read, and only free frames are used, so readahead never
+ *  replaces a page. The number of pages read is the stream's window,
+ *  which grows on hits and shrinks on misses. The process was already
+ *  restarted and may quit during the reads, so it is pinned, and the
+ *  frames of pages that weren't read or that it quit before are given
+ *  back.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+Readahead(PID pid, int page)
+{
+	Stream *stream = &streams[pid];
+
+	if (stream->lastPage != -1 && page - stream->lastPage == stream->stride && stream->stride != 0){
+		stream->run++;
+	}
+	else {
+		stream->stride = stream->lastPage == -1 ? 0 : page - stream->lastPage;
+		stream->run = 0;
+	}
+	stream->lastPage = page;
+	if (stream->run < 1){
+		return;
+	}
+
+	// with asyncSwap all the reads are started before any of them is waited for
+	// each page read takes a free frame, so there are never more of them than frames
+	int *pages = P3SlabAlloc(P3_SLAB_FRAME_LIST);
+	int *frames = P3SlabAlloc(P3_SLAB_FRAME_LIST);
+	int *ios = P3SlabAlloc(P3_SLAB_FRAME_LIST);
+	int count = 0;
+	int life = PidPin(pid);
+
+	for (int k = 1; k <= stream->window && count < P3_vmStats.frames; k++){
+		int next = page + stream->stride * k;
+		if (next < 0 || next >= P3_vmStats.pages){
+			break;
+		}
+		if (PageIncore(pid, next) != 0 || !P3SwapCached(pid, next)){
+			continue;
+		}
+
+		int frame = FrameTake(pid, next, 0);
+		if (frame == -1){
+			break;
+		}
+		rc = P1_P(freeFramesSid);
+		assert(rc == P1_SUCCESS);
+		P3_frames.flags[frame] |= P3_FRAME_READAHEAD;
+		rc = P1_V(freeFramesSid);
+		assert(rc == P1_SUCCESS);
+
+		// the slot may be gone by now if the process is quitting
+		if (P3_pagerOptions.asyncSwap){
+			rc = P3SwapInStart(pid, next, frame, &ios[count]);
+		}
+		else {
+			rc = P3SwapIn(pid, next, frame);
+			ios[count] = -1;
+		}
+		pages[count] = next;
+		frames[count] = frame;
+		if (rc != P1_SUCCESS){
+			frames[count] = -1;
+			FrameReturn(frame);
+		}
+		count++;
+	}
+
+	for (int n = 0; n < count; n++){
+		if (ios[n] != -1){
+			rc = P3SwapFinish(ios[n]);
+			assert(rc == P1_SUCCESS);
+		}
+		if (frames[n] == -1){
+			continue;
+		}
+
+		// the pager touched the frame reading it, only the process's references count
+		rc = USLOSS_MmuSetAccess(frames[n], 0);
+		assert(rc == USLOSS_MMU_OK);
+
+		if (PageMapPinned(pid, life, pages[n], frames[n])){
+			P3_pagerStats.readaheads++;
+		}
+	}
+	PidUnpin(pid);
+
+	P3SlabFree(P3_SLAB_FRAME_LIST, pages);
+	P3SlabFree(P3_SLAB_FRAME_LIST, frames);
+	P3SlabFree(P3_SLAB_FRAME_LIST, ios);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Pager --
+ *
+ *  Handles page faults
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Pager(void *arg)
+{
+	kernelMode();
+
+	while (1){
+		
+		// will pause here until there exists a fault
+		rc = P1_P(emptyFaultSid);
+		assert(rc == P1_SUCCESS);
+
+		// P3PagerShutdown wakes us up to quit
+		if (!numPagers){
+			break;
+		}
+		
+		// locks fault list
+		rc = P1_P(faultListSid);
+		assert(rc == P1_SUCCESS);
+
+		// grabs first fault
+		struct FaultList *node = head;
+		head = head->next;
+
+		// faults of suspended processes wait until load control resumes them
+		if (suspended[node->fault.pid]){
+			FaultAppend(&parked, node);
+			node = NULL;
+		}
+		
+		// unlocks fault list
+		rc = P1_V(faultListSid);
+		assert(rc == P1_SUCCESS);
+
+		if (node == NULL){
+			continue;
+		}
+
+		Fault *currFault = &node->fault;
+		int start = Now();
+
+		// prefetch jobs queued by P3PagerSpawn have nobody waiting on them
+		if (currFault->prefetch != NULL){
+			Prefetch(currFault);
+			P3SlabFree(P3_SLAB_FAULT, node);
+			continue;
+		}
+
+		if (currFault->cause == USLOSS_MMU_ACCESS) {
+			rc = P1_V(currFault->wait);
+			assert(rc == P1_SUCCESS);
+			continue;	
+		}
+
+        int faultPage = currFault->offset / USLOSS_MmuPageSize();
+
+		if (P3_pagerOptions.readahead){
+			ReadaheadCheck(currFault->pid);
+		}
+		if (recordings[currFault->pid].active){
+			ProfileRecord(currFault->pid, faultPage);
+		}
+
+		// take a free frame if there is one, otherwise replace a page
+		int currFrame = FrameTake(currFault->pid, faultPage, 0);
+		int writeIO = -1;
+
+		// a quitting process's frames are reused before a live process's page is replaced
+		while (currFrame == -1 && P3Reap()){
+			currFrame = FrameTake(currFault->pid, faultPage, 0);
+		}
+
+		if (currFrame == -1){
+			// with asyncSwap the victim is copied out and written while the fault is read
+			if (P3_pagerOptions.asyncSwap){
+				rc = P3SwapOutStart(&currFrame, &writeIO);
+			}
+			else {
+				rc = P3SwapOut(&currFrame);
+			}
+			assert(rc == P1_SUCCESS);
+
+			rc = P1_P(freeFramesSid);
+			assert(rc == P1_SUCCESS);
+			if (P3_frames.flags[currFrame] & P3_FRAME_READAHEAD){
+				// read ahead for nothing, shrink the owner's window
+				Stream *stream = &streams[P3_frames.pid[currFrame]];
+				stream->window = stream->window > 1 ? stream->window / 2 : 1;
+				P3_frames.flags[currFrame] &= ~P3_FRAME_READAHEAD;
+				P3_pagerStats.readaheadMisses++;
+			}
+			P3FrameOwnerSet(currFrame, currFault->pid, faultPage);
+			P3_vmStats.replaced++;
+			rc = P1_V(freeFramesSid);
+			assert(rc == P1_SUCCESS);
+		}
+
+		if (writeIO != -1){
+			int readIO;
+			int result = P3SwapInStart(currFault->pid, faultPage, currFrame, &readIO);
+			if (readIO != -1){
+				P3_pagerStats.overlapped++;
+				rc = P3SwapFinish(readIO);
+				assert(rc == P1_SUCCESS);
+			}
+			rc = P3SwapFinish(writeIO);
+			assert(rc == P1_SUCCESS);
+			rc = result;
+		}
+		else {
+			rc = P3SwapIn(currFault->pid, faultPage, currFrame);
+		}
+
+		int empty = rc == P3_EMPTY_PAGE;
+		if (rc == P3_EMPTY_PAGE){
+			FrameZero(currFrame);
+			P3_vmStats.new++;
+		}
+		else if (rc == P3_OUT_OF_SWAP){
+			
+			//kill the faulting process
+			rc = P1_P(freeFramesSid);
+			assert(rc == P1_SUCCESS);
+			FrameRelease(currFrame);
+			rc = P1_V(freeFramesSid);
+			assert(rc == P1_SUCCESS);
+
+			currFault->outOfSwap = 1; 
+			rc = P1_V(currFault->wait);
+			assert(rc == P1_SUCCESS);
+			continue;
+		}
+		else {
+			assert(rc == P1_SUCCESS);
+		}
+
+		// map the untouched pages around a new page too, so they don't fault
+		if (empty && faultAround[currFault->pid] > 1){
+			FaultAround(currFault->pid, faultPage);
+		}
+
+		//update PTE in faulting process's page table to map page to frame
+
+		PageMap(currFault->pid, faultPage, currFrame);
+
+		rc = P1_P(pagersStatsSid);
+		assert(rc == P1_SUCCESS);
+		pagerBusy += Now() - start;
+		rc = P1_V(pagersStatsSid);
+		assert(rc == P1_SUCCESS);
+
+		// unblock faulting process
+		rc = P1_V(currFault->wait);
+		assert(rc == P1_SUCCESS);
+
+		// the faulting process can run while the pages ahead of it are read
+		if (P3_pagerOptions.readahead){
+			Readahead(currFault->pid, faultPage);
+		}
+	}
+
+	rc = P1_V(pagersDoneSid);
+	assert(rc == P1_SUCCESS);
 
     /********************************
 
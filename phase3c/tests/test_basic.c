@@ -149,4 +149,10 @@ int P3SwapInit(int pages, int frames) {return P1_SUCCESS;}
 int P3SwapShutdown(void) {return P1_SUCCESS;}
 int P3SwapFreeAll(PID pid) {return P1_SUCCESS;}
 int P3SwapOut(int *frame) {return P1_SUCCESS;}
+int P3SwapOutProcess(PID pid, int *frames, int *count) {*count = 0; return P1_SUCCESS;}
+int P3SwapInBatch(PID pid, int *pages, int *frames, int count) {for (int n = 0; n < count; n++) frames[n] = -1; return P1_SUCCESS;}
+int P3SwapCached(PID pid, int page) {return FALSE;}
+int P3SwapOutStart(int *frame, int *io) {*io = -1; return P3SwapOut(frame);}
+int P3SwapInStart(PID pid, int page, int frame, int *io) {*io = -1; return P3SwapIn(pid, page, frame);}
+int P3SwapFinish(int io) {return P1_SUCCESS;}
 int P3SwapIn(PID pid, int page, int frame) {return P3_EMPTY_PAGE;}
\ No newline at end of file
@@ -0,0 +1,160 @@
+/*
+ * test_leaves.c
+ *
+ *  Tests the page table's directory of leaves. The child touches one page in each of
+ *  three leaves of a region much larger than physical memory. P3SwapIn checks that the
+ *  faulting page and a page that was never touched aren't incore, maps the untouched page
+ *  and unmaps it again to check that lookups follow, then fills the frame with the page
+ *  number as in test_map. Each touched page must fault exactly once.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 40        // # of pages, spread over three leaves
+#define FRAMES 4        // # of frames
+#define SPARE 8         // offset of a page that is never touched from each touched one
+#define PAGERS 2        // # of pagers
+
+static char *vmRegion;
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+int debugging = 1;
+#else
+int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+static int touched[] = {0, 17, 35};
+static int numTouched = sizeof(touched) / sizeof(int);
+
+static int
+Child(void *arg)
+{
+    char    *page;
+    int     pid;
+
+    Sys_GetPID(&pid);
+    Debug("Child (%d) starting.\n", pid);
+
+    // Pages should be filled with their page numbers.
+    for (int i = 0; i < numTouched; i++) {
+        int j = touched[i];
+        page = vmRegion + j * pageSize;
+        Debug("Child reading from page %d @ %p\n", j, page);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], j);
+        }
+    }
+    Debug("Child done.\n");
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+    Debug("Child terminated\n");
+    Sys_VmShutdown();
+    TEST(P3_vmStats.faults, numTouched);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+}
+
+void test_cleanup(int argc, char **argv) {
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
+
+// Phase 3d stubs
+
+#include "phase3Int.h"
+
+int P3SwapInit(int pages, int frames) {return P1_SUCCESS;}
+int P3SwapShutdown(void) {return P1_SUCCESS;}
+int P3SwapFreeAll(PID pid) {return P1_SUCCESS;}
+int P3SwapOut(int *frame) {return P1_SUCCESS;}
+int P3SwapOutProcess(PID pid, int *frames, int *count) {*count = 0; return P1_SUCCESS;}
+int P3SwapInBatch(PID pid, int *pages, int *frames, int count) {for (int n = 0; n < count; n++) frames[n] = -1; return P1_SUCCESS;}
+int P3SwapCached(PID pid, int page) {return FALSE;}
+int P3SwapOutStart(int *frame, int *io) {*io = -1; return P3SwapOut(frame);}
+int P3SwapInStart(PID pid, int page, int frame, int *io) {*io = -1; return P3SwapIn(pid, page, frame);}
+int P3SwapFinish(int io) {return P1_SUCCESS;}
+int P3SwapIn(PID pid, int page, int frame) {
+    int rc = 0;
+    void *addr;
+    USLOSS_PTE pte;
+    int spare = (page + SPARE) % PAGES;
+    Debug("P3SwapIn PID %d page %d frame %d.\n", pid, page, frame);
+    rc = P3PageTableLookup(pid, page, &pte);
+    TEST(rc, P1_SUCCESS);
+    TEST(pte.incore, 0);
+    rc = P3PageTableLookup(pid, spare, &pte);
+    TEST(rc, P1_SUCCESS);
+    TEST(pte.incore, 0);
+    rc = P3PageTableLookup(pid, PAGES, &pte);
+    TEST(rc, P3_INVALID_PAGE);
+
+    pte.incore = 1;
+    pte.read = 1;
+    pte.write = 1;
+    pte.frame = frame;
+    rc = P3PageTableUpdate(pid, spare, &pte);
+    TEST(rc, P1_SUCCESS);
+    rc = P3PageTableLookup(pid, spare, &pte);
+    TEST(rc, P1_SUCCESS);
+    TEST(pte.incore, 1);
+    TEST(pte.frame, frame);
+    pte.incore = 0;
+    rc = P3PageTableUpdate(pid, spare, &pte);
+    TEST(rc, P1_SUCCESS);
+    rc = P3PageTableLookup(pid, spare, &pte);
+    TEST(rc, P1_SUCCESS);
+    TEST(pte.incore, 0);
+
+    rc = P3FrameMap(frame, &addr);
+    TEST(rc, P1_SUCCESS);
+    memset(addr, page, pageSize);
+    rc = P3FrameUnmap(frame);
+    TEST(rc, P1_SUCCESS);
+    return P1_SUCCESS;
+}
@@ -0,0 +1,172 @@
+/*
+ * test_rmap.c
+ *
+ *  Tests the reverse map. The child reads the first third of its pages. For each fault
+ *  P3SwapIn maps the frame into an alias in the second third and a spare in the last third,
+ *  checks that unmapping the frame unmaps both, then maps the alias again and fills the
+ *  frame with the page number. The child then reads the aliases, which must share the
+ *  frames of the first third without faulting.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define FRAMES 4        // # of frames
+#define PAGES (3 * FRAMES) // # of pages: the child's pages, their aliases, and spares
+#define PAGERS 2        // # of pagers
+
+static char *vmRegion;
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+int debugging = 1;
+#else
+int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+static int
+Child(void *arg)
+{
+    char    *page;
+    int     pid;
+
+    Sys_GetPID(&pid);
+    Debug("Child (%d) starting.\n", pid);
+
+    // Pages should be filled with their page numbers, and the aliases share their frames.
+    for (int j = 0; j < FRAMES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child reading from page %d @ %p\n", j, page);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], j);
+        }
+    }
+    for (int j = FRAMES; j < 2 * FRAMES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child reading from alias %d @ %p\n", j, page);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], j - FRAMES);
+        }
+    }
+    Debug("Child done.\n");
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+    Debug("Child terminated\n");
+    Sys_VmShutdown();
+    TEST(P3_vmStats.faults, FRAMES);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+}
+
+void test_cleanup(int argc, char **argv) {
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
+
+// Phase 3d stubs
+
+#include "phase3Int.h"
+
+int P3SwapInit(int pages, int frames) {return P1_SUCCESS;}
+int P3SwapShutdown(void) {return P1_SUCCESS;}
+int P3SwapFreeAll(PID pid) {return P1_SUCCESS;}
+int P3SwapOut(int *frame) {return P1_SUCCESS;}
+int P3SwapOutProcess(PID pid, int *frames, int *count) {*count = 0; return P1_SUCCESS;}
+int P3SwapInBatch(PID pid, int *pages, int *frames, int count) {for (int n = 0; n < count; n++) frames[n] = -1; return P1_SUCCESS;}
+int P3SwapCached(PID pid, int page) {return FALSE;}
+int P3SwapOutStart(int *frame, int *io) {*io = -1; return P3SwapOut(frame);}
+int P3SwapInStart(PID pid, int page, int frame, int *io) {*io = -1; return P3SwapIn(pid, page, frame);}
+int P3SwapFinish(int io) {return P1_SUCCESS;}
+int P3SwapIn(PID pid, int page, int frame) {
+    int rc = 0;
+    int count;
+    void *addr;
+    USLOSS_PTE pte;
+    int alias = page + FRAMES;
+    int spare = page + 2 * FRAMES;
+    Debug("P3SwapIn PID %d page %d frame %d.\n", pid, page, frame);
+
+    // the alias and the spare share the frame
+    pte.incore = 1;
+    pte.read = 1;
+    pte.write = 1;
+    pte.frame = frame;
+    rc = P3PageTableUpdate(pid, alias, &pte);
+    TEST(rc, P1_SUCCESS);
+    rc = P3PageTableUpdate(pid, spare, &pte);
+    TEST(rc, P1_SUCCESS);
+    rc = P3PageTableLookup(pid, alias, &pte);
+    TEST(rc, P1_SUCCESS);
+    TEST(pte.incore, 1);
+    TEST(pte.frame, frame);
+
+    // unmapping the frame unmaps both of them
+    rc = P3PageTableUnmapFrame(frame, &count);
+    TEST(rc, P1_SUCCESS);
+    TEST(count, 2);
+    rc = P3PageTableLookup(pid, alias, &pte);
+    TEST(rc, P1_SUCCESS);
+    TEST(pte.incore, 0);
+    rc = P3PageTableLookup(pid, spare, &pte);
+    TEST(rc, P1_SUCCESS);
+    TEST(pte.incore, 0);
+
+    // map the alias again for the child to read
+    pte.incore = 1;
+    pte.read = 1;
+    pte.write = 1;
+    pte.frame = frame;
+    rc = P3PageTableUpdate(pid, alias, &pte);
+    TEST(rc, P1_SUCCESS);
+
+    rc = P3FrameMap(frame, &addr);
+    TEST(rc, P1_SUCCESS);
+    memset(addr, page, pageSize);
+    rc = P3FrameUnmap(frame);
+    TEST(rc, P1_SUCCESS);
+    return P1_SUCCESS;
+}
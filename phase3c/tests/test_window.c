@@ -0,0 +1,158 @@
+/*
+ * test_window.c
+ *
+ *  Tests the window pages P3FrameMap maps frames through. P3SwapIn maps the frame it is
+ *  given into every window at once, fills it through one window and checks it through the
+ *  others, checks that there is no window left for another mapping, and unmaps them all.
+ *  It then maps the frame once more, which should reuse a window the MMU still maps to
+ *  the frame instead of reloading the window table, and checks the contents again.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 4         // # of pages, also the # of windows
+#define FRAMES PAGES    // # of frames
+#define PAGERS 2        // # of pagers
+
+static char *vmRegion;
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+int debugging = 1;
+#else
+int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+static int
+Child(void *arg)
+{
+    int     j;
+    char    *page;
+    int     pid;
+
+    Sys_GetPID(&pid);
+    Debug("Child (%d) starting.\n", pid);
+
+    // Pages should be filled with their page numbers. 
+    for (j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child reading from page %d @ %p\n", j, page);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], j);
+        }
+    }
+    Debug("Child done.\n");
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+    Debug("Child terminated\n");
+    Sys_VmShutdown();
+
+    TEST(P3_pagerStats.tableReloads > 0, 1);
+    TEST(P3_pagerStats.reloadsSkipped > 0, 1);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+}
+
+void test_cleanup(int argc, char **argv) {
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
+
+// Phase 3d stubs
+
+#include "phase3Int.h"
+
+int P3SwapInit(int pages, int frames) {return P1_SUCCESS;}
+int P3SwapShutdown(void) {return P1_SUCCESS;}
+int P3SwapFreeAll(PID pid) {return P1_SUCCESS;}
+int P3SwapOut(int *frame) {return P1_SUCCESS;}
+int P3SwapOutProcess(PID pid, int *frames, int *count) {*count = 0; return P1_SUCCESS;}
+int P3SwapInBatch(PID pid, int *pages, int *frames, int count) {for (int n = 0; n < count; n++) frames[n] = -1; return P1_SUCCESS;}
+int P3SwapCached(PID pid, int page) {return FALSE;}
+int P3SwapOutStart(int *frame, int *io) {*io = -1; return P3SwapOut(frame);}
+int P3SwapInStart(PID pid, int page, int frame, int *io) {*io = -1; return P3SwapIn(pid, page, frame);}
+int P3SwapFinish(int io) {return P1_SUCCESS;}
+int P3SwapIn(PID pid, int page, int frame) {
+    int rc = 0;
+    char *addrs[PAGES];
+    void *addr;
+    Debug("P3SwapIn PID %d page %d frame %d.\n", pid, page, frame);
+    for (int w = 0; w < PAGES; w++) {
+        rc = P3FrameMap(frame, (void **) &addrs[w]);
+        TEST(rc, P1_SUCCESS);
+        for (int v = 0; v < w; v++) {
+            TEST(addrs[v] != addrs[w], 1);
+        }
+    }
+    rc = P3FrameMap(frame, &addr);
+    TEST(rc, P3_OUT_OF_PAGES);
+    memset(addrs[0], page, pageSize);
+    for (int w = 1; w < PAGES; w++) {
+        for (int k = 0; k < pageSize; k++) {
+            TEST(addrs[w][k], page);
+        }
+    }
+    for (int w = 0; w < PAGES; w++) {
+        rc = P3FrameUnmap(frame);
+        TEST(rc, P1_SUCCESS);
+    }
+    rc = P3FrameUnmap(frame);
+    TEST(rc, P3_FRAME_NOT_MAPPED);
+
+    int skipped = P3_pagerStats.reloadsSkipped;
+    rc = P3FrameMap(frame, &addr);
+    TEST(rc, P1_SUCCESS);
+    TEST(P3_pagerStats.reloadsSkipped, skipped + 1);
+    for (int k = 0; k < pageSize; k++) {
+        TEST(((char *) addr)[k], page);
+    }
+    rc = P3FrameUnmap(frame);
+    TEST(rc, P1_SUCCESS);
+    return P1_SUCCESS;
+}
@@ -36,8 +36,6 @@ disk I/O.
 #include <string.h>
 #include <libuser.h>
 
-#define DEBUG 1
-
 #include "phase3.h"
 #include "phase3Int.h"
 
@@ -69,10 +67,26 @@ typedef struct SwapSpace {
     int pid;
     int page;
     int allocated;
+    int block;      // block holding the page uncompressed, -1 if none
+    int pack;       // pack holding the page compressed, -1 if none
+    int packOffset; // where the page is in the pack
+    int packLength;
+    int nextOwned;  // next slot on the owner's list, -1 if none
+    int prevOwned;  // previous slot on the owner's list, -1 if none
+    int written;    // slotWrites when the slot was last written, moved or freed
 
 } SwapSpace;
 
 int swapTableSem;
+int slotWrites;     // # of times a slot's contents changed, stamps SwapSpace.written
+
+// first slot on each process's list of slots, -1 if none, so freeing a process's swap
+// space takes time proportional to how much it has
+int ownedSlots[P1_MAXPROC];
+
+// P3SwapInBatch's slot and read order for each page, a frame's worth, used under swapTableSem
+int *batchSlots;
+int *batchOrder;
 
 int vmStats;
 
@@ -82,17 +96,206 @@ int swapTableSize;
 int clockHand;
 int hand = -1;
 
-typedef struct Frame {
-    
-    int pid;
-    int page;
-    int busy;
+// The frame descriptors are the frame layer's P3_frames, protected by P3_frames.sem.
+
+// Aging replacement. The age counters are P3_frames.age, a byte per frame, so picking
+// a victim is a linear scan over frames bytes.
+
+#define AGE_REFERENCED  0x80    // bit shifted in when a frame was referenced
 
-} Frame;
+int agerPid = -1;
+int agerRunning = 0;
+SID agerDone;                   // V'ed by the ager when it quits
 
-Frame *frameTable;
+// Page-fault-frequency resident sets. Each process has a target number of frames that grows
+// when it faults often and shrinks when it doesn't. In local mode P3SwapOut takes victims from
+// processes that are over their target before it considers anyone else.
 
-int frameTableSem;
+typedef struct ResidentSet {
+
+    int resident;   // # of frames the process owns
+    int target;     // # of frames the process should own
+    int lastFault;  // time of the process's last fault
+
+} ResidentSet;
+
+ResidentSet residentSets[P1_MAXPROC];
+
+P3_SwapOptions  P3_swapOptions = {
+    .replacement = P3_REPLACE_CLOCK,
+    .agingInterval = 1,
+    .local = 0,
+    .initialTarget = 2,
+    .pffGrow = 100000,
+    .pffShrink = 1000000,
+    .cluster = 1,
+    .clusterCache = 8,
+    .clusterTTL = 2000000,
+    .elevator = 0,
+    .ioDeadline = 500000,
+    .async = 0,
+    .units = 1,
+    .stripe = 1,
+    .fastSlots = 0,
+    .demoteAge = 2000000,
+    .migrateInterval = 1,
+    .compress = 0,
+    .extents = 0,
+    .compactInterval = 0,
+    .compactBatch = 4,
+};
+P3_SwapStats    P3_swapStats;
+
+// Swap cluster cache. When P3SwapIn reads a slot it also reads the following slots on the
+// same track that hold non-resident pages of the same process, and keeps them here for a
+// short while in case the process faults on them.
+
+typedef struct CachedSlot {
+
+    int slot;       // swap slot, -1 if the entry is empty
+    int when;       // time the slot was read
+    char *data;     // contents of the slot
+
+} CachedSlot;
+
+CachedSlot *swapCache;
+int swapCacheSem;
+
+// Fast swap tier. With P3_swapOptions.fastSlots set, evicted pages are kept in memory instead
+// of being written to the swap disk, and a page stays there as long as it keeps being faulted
+// back in. The migrator demotes slots that haven't been used for demoteAge to the disk, and
+// when the tier is full the least recently used slot is demoted to make room. A page in the
+// fast tier is newer than its copy on the disk.
+
+typedef struct FastSlot {
+
+    int slot;       // swap slot, -1 if the entry is empty
+    int when;       // time the slot was last written or read
+    char *data;     // contents of the slot
+
+} FastSlot;
+
+FastSlot *fastTier;
+int fastTierSem;
+int migratorPid = -1;
+int migratorRunning = 0;
+SID migratorDone;               // V'ed by the migrator when it quits
+
+// Compressed swap. A slot in swapTable is a page that has swap space; the block is where its
+// contents are on the disk. Without P3_swapOptions.compress slot i is always in block i. With
+// it, a page that compresses to at most half of a pack's room is packed with others into one
+// block, which starts with a directory of the pages in it, and other pages get a block when
+// they are written. There are PACK_PAGES times as many slots as blocks, and freeBlocks counts
+// the blocks that are really unused.
+
+#define PACK_PAGES  8           // most pages in a pack
+
+typedef struct PackEntry {
+
+    int slot;
+    int offset;                 // where the compressed page starts in the block
+    int length;
+
+} PackEntry;
+
+typedef struct PackHeader {     // directory at the start of a pack's block
+
+    int count;
+    PackEntry entries[PACK_PAGES];
+
+} PackHeader;
+
+typedef struct Pack {
+
+    int block;                  // block the pack was written to, -1 if it is open or unused
+    int live;                   // # of pages in the pack that are still current
+    int used;                   // # of bytes used, 0 if the pack is unused
+    char *data;                 // contents while the pack is open and hasn't been written
+
+} Pack;
+
+Pack *packs;
+int openPack = -1;              // pack new pages go in, -1 if none
+char *blockUsed;
+int blocksNum;
+int packSem;                    // mutex for packs and blockUsed
+
+// Swap extents. With P3_swapOptions.extents set, each process reserves runs of slotsPerTrack
+// slots that start on a track boundary, one for each slotsPerTrack pages of its address space,
+// and page p goes in slot base + p % slotsPerTrack of its run. A process's pages are then in
+// the same order on the disk as in memory. The reservation is only a preference: when there is
+// no free run, or the slot is taken, the page goes in the first free slot.
+
+int slotsPerTrack;
+int extentsNum;                 // # of runs in swapTable
+int *extentOwner;               // process each run is reserved for, -1 if none
+int *processExtents[P1_MAXPROC];// run reserved for each group of a process's pages, -1 if none
+int extentGroups;               // # of groups of slotsPerTrack pages in an address space
+
+// Swap compaction. With P3_swapOptions.compactInterval set, the compactor wakes up that often
+// and, if no swap I/O is outstanding, moves up to compactBatch live slots into the first free
+// slot, preferring the slot that continues the run of pages before it. Free space collects at
+// the end of swapTable and each process's pages end up next to each other. The page is copied
+// without any locks held and the hole is reserved meanwhile. The move is then committed while
+// holding the clockHand mutex and swapTableSem, but only if the slot didn't change during the
+// copy, so no fault or eviction waits for the copy or sees the slot half moved.
+
+int compactorPid = -1;
+int compactorRunning = 0;
+SID compactorDone;              // V'ed by the compactor when it quits
+int compactHole = -1;           // free slot the compactor is copying into, -1 if none
+
+// Swap I/O scheduler. Disk requests come from a fixed pool so several can be outstanding at
+// once, each with its own completion semaphore. With P3_swapOptions.elevator or
+// P3_swapOptions.async set, requests are queued and a scheduler process issues them; the
+// elevator issues them in C-SCAN order and merges requests for adjacent sectors, otherwise
+// they are issued in the order they were queued. Without the scheduler a request is issued
+// as soon as it is submitted.
+
+#define IO_REQUESTS 32          // # of requests that can be outstanding
+
+typedef struct IORequest {
+
+    int inUse;
+    int write;                  // 1 for a write, 0 for a read
+    int unit;                   // disk unit
+    int track;
+    int first;                  // first sector
+    int sectors;
+    char *buffer;
+    int slab;                   // slab the buffer goes back to with the request, -1 if none
+    int when;                   // time the request was queued
+    int seq;                    // order the request was submitted in
+    int result;
+    SID done;                   // the requester waits on this
+    int slot;                   // swap slot for P3SwapFinish, -1 if none
+    int frame;                  // frame being read into by P3SwapInStart
+    int cluster;                // # of slots being read by P3SwapInStart
+    int stamp;                  // slotWrites when the read was submitted
+    struct IORequest *next;
+
+} IORequest;
+
+// Each disk unit swap is striped across has its own queue and scheduler, so the units work
+// in parallel.
+
+typedef struct IOUnit {
+
+    IORequest *queue;
+    int pendingSem;             // # of requests in queue
+    int depth;                  // # of requests in queue
+    int head;                   // track of the last request issued
+    char *merge;                // a track's worth of buffer for merged requests
+
+} IOUnit;
+
+IORequest ioRequests[IO_REQUESTS];
+IOUnit ioUnits[USLOSS_DISK_UNITS];
+int ioQueueSem;                 // mutex for the queues and ioRequests
+int ioFreeSem;                  // # of unused entries in ioRequests
+int ioDoneSem;                  // each scheduler V's this when it quits
+int ioRunning = 0;
+int ioSeq = 0;                  // # of requests submitted, numbers them
 
 int initialized = 0;
 int rc;
@@ -101,6 +304,9 @@ int i;
 int sectorByte;
 int sectorNum;
 int trackNum;
+int unitsNum;                   // # of disk units swap is striped across
+#define SWAP_UNIT(k)    ((P3_SWAP_DISK + (k)) % USLOSS_DISK_UNITS)  // disk unit of the kth stripe
+int unitSlots;                  // # of slots on each unit
 
 int sectorInPage;
 
@@ -113,14 +319,64 @@ int framesNum;
 
 int getSector(int);
 int getTrack(int);
+int getUnit(int);
 void printSwapTable(void);
 void printFrameTable(void);
 
+static int ClockSelect(int local);
+static int AgingSelect(int local);
+static void FrameWait(void);
+static int OverTarget(int frame);
+static void ResidentSetFault(PID pid);
+static void Evict(int target);
+static void FrameAssign(int frame, PID pid, int page, int slot);
+static int ClusterLength(int slot, PID pid);
+static void CachePut(int slot, void *data);
+static int CacheTake(int slot, void *data);
+static void CacheDrop(int slot);
+static int FastPut(int slot, void *data);
+static int FastGet(int slot, void *data);
+static int FastHas(int slot);
+static void FastDrop(int slot);
+static int FastDemote(int e);
+static int Migrator(void *arg);
+static int Compactor(void *arg);
+static int CompactMove(void);
+static int SlotAlloc(PID pid, int page);
+static int SlotFree(int slot);
+static void SlotOwn(int slot, PID pid, int page);
+static void SwapFragmentation(PID pid);
+static int SlotWrite(int slot, void *data);
+static void PackRead(int slot, void *addr);
+static void PackRemove(int slot);
+static void PackFlush(void);
+static int BlockAlloc(void);
+static void BlockFree(int block);
+static int Compress(unsigned char *src, unsigned char *dst, int limit);
+static void Decompress(unsigned char *src, int length, unsigned char *dst);
+static int Ager(void *arg);
+static int EvictStart(int target);
+static int Contiguous(int slot, int n);
+static int SwapDiskIO(int write, int unit, int track, int first, int sectors, void *buffer);
+static int IOSubmit(int write, int unit, int track, int first, int sectors, void *buffer, int slot,
+                    int slab);
+static int IOWait(int io);
+static void IOFree(int io);
+static int IOForward(int slot, void *addr);
+static void IOUnlink(IOUnit *u, IORequest *req);
+static int IOScheduler(void *arg);
+
 //////////////////////////////////////////////////////////
 /*
- * swaptable[i] => i = sectorInPage * i
+ * Blocks are striped round-robin across the units, P3_swapOptions.stripe blocks at a time:
  *
- * sectorIndex = sectorInPage * i
+ * stripe = i / P3_swapOptions.stripe
+ *
+ * unit = P3_SWAP_DISK + stripe % unitsNum (mod USLOSS_DISK_UNITS)
+ *
+ * unitSlot = (stripe / unitsNum) * P3_swapOptions.stripe + i % P3_swapOptions.stripe
+ *
+ * sectorIndex = sectorInPage * unitSlot
  *
  * track = sectorIndex / sectorNum
  *
@@ -129,12 +385,32 @@ void printFrameTable(void);
  *
  */
 
+static int getUnitSlot(int i) {
+    int stripe = i / P3_swapOptions.stripe;
+    return (stripe / unitsNum) * P3_swapOptions.stripe + i % P3_swapOptions.stripe;
+}
+
+int getUnit(int i) {
+    return SWAP_UNIT((i / P3_swapOptions.stripe) % unitsNum);
+}
+
 int getSector(int i) {
-    return (sectorInPage * i) % sectorNum;
+    return (sectorInPage * getUnitSlot(i)) % sectorNum;
 }
 
 int getTrack(int i) {
-    return (sectorInPage * i) / sectorNum;
+    return (sectorInPage * getUnitSlot(i)) / sectorNum;
+}
+
+/*
+ * Checks whether block slot + n follows block slot on the same unit and track, so both can be
+ * read with one disk operation.
+ */
+static int
+Contiguous(int slot, int n)
+{
+    return slot + n < blocksNum && getUnit(slot + n) == getUnit(slot) &&
+        getUnitSlot(slot + n) == getUnitSlot(slot) + n && getTrack(slot + n) == getTrack(slot);
 }
 
 /*
@@ -169,32 +445,175 @@ P3SwapInit(int pages, int frames)
 
     pageSize = USLOSS_MmuPageSize();
     sectorInPage = pageSize / sectorByte;
-    swapTableSize = (sectorByte * sectorNum * trackNum) / pageSize;
+
+    // every unit holds as many slots as the smallest one, in whole stripes
+    unitsNum = P3_swapOptions.units;
+    if (unitsNum < 1 || unitsNum > USLOSS_DISK_UNITS) {
+        unitsNum = 1;
+    }
+    if (P3_swapOptions.stripe < 1) {
+        P3_swapOptions.stripe = 1;
+    }
+    unitSlots = (sectorByte * sectorNum * trackNum) / pageSize;
+    for (int k = 1; k < unitsNum; k++) {
+        int unitBytes, unitSectors, unitTracks;
+        rc = P2_DiskSize(SWAP_UNIT(k), &unitBytes, &unitSectors, &unitTracks);
+        assert(rc == P1_SUCCESS);
+        assert(unitBytes == sectorByte && unitSectors == sectorNum);
+        if ((unitBytes * unitSectors * unitTracks) / pageSize < unitSlots) {
+            unitSlots = (unitBytes * unitSectors * unitTracks) / pageSize;
+        }
+    }
+    if (unitsNum > 1) {
+        unitSlots -= unitSlots % P3_swapOptions.stripe;
+    }
+    blocksNum = unitSlots * unitsNum;
+    swapTableSize = P3_swapOptions.compress ? blocksNum * PACK_PAGES : blocksNum;
     
-    swapTable = (SwapSpace*) malloc(sizeof(SwapSpace) * swapTableSize);
+    // the swap metadata lives in the VM arena and goes with it at shutdown
+    swapTable = (SwapSpace*) P3ArenaAlloc(sizeof(SwapSpace) * swapTableSize);
 
     for (i = 0; i < swapTableSize; i++) {
         swapTable[i].pid = -1;
         swapTable[i].page = -1;
         swapTable[i].allocated = 0;
+        swapTable[i].block = P3_swapOptions.compress ? -1 : i;
+        swapTable[i].pack = -1;
+        swapTable[i].nextOwned = -1;
+        swapTable[i].prevOwned = -1;
+        swapTable[i].written = 0;
+    }
+    slotWrites = 0;
+    for (i = 0; i < P1_MAXPROC; i++) {
+        ownedSlots[i] = -1;
+    }
+
+    blockUsed = P3ArenaAlloc(blocksNum);
+    packs = (Pack*) P3ArenaAlloc(sizeof(Pack) * blocksNum);
+    for (i = 0; i < blocksNum; i++) {
+        packs[i].block = -1;
+        packs[i].live = 0;
+        packs[i].used = 0;
+        packs[i].data = NULL;
+    }
+    openPack = -1;
+    rc = P1_SemCreate("Packs", 1, &packSem);
+    assert(rc == P1_SUCCESS);
+
+    // the buffers evicting, swapping in and packing pages take come from the VM arena too
+    rc = P3SlabInit(P3_SLAB_PAGE, pageSize, IO_REQUESTS);
+    assert(rc == P1_SUCCESS);
+    if (P3_swapOptions.cluster > 1) {
+        rc = P3SlabInit(P3_SLAB_CLUSTER, P3_swapOptions.cluster * pageSize, P3_MAX_PAGERS);
+        assert(rc == P1_SUCCESS);
+    }
+
+    slotsPerTrack = sectorNum / sectorInPage > 0 ? sectorNum / sectorInPage : 1;
+    extentsNum = swapTableSize / slotsPerTrack;
+    extentGroups = (pages + slotsPerTrack - 1) / slotsPerTrack;
+    extentOwner = (int*) P3ArenaAlloc(sizeof(int) * extentsNum);
+    for (i = 0; i < extentsNum; i++) {
+        extentOwner[i] = -1;
+    }
+    for (i = 0; i < P1_MAXPROC; i++) {
+        processExtents[i] = (int*) P3ArenaAlloc(sizeof(int) * extentGroups);
+        for (int g = 0; g < extentGroups; g++) {
+            processExtents[i][g] = -1;
+        }
     }
 
+    batchSlots = (int*) P3ArenaAlloc(sizeof(int) * frames);
+    batchOrder = (int*) P3ArenaAlloc(sizeof(int) * frames);
+
     rc = P1_SemCreate("Swap Table", 1, &swapTableSem);
     
     rc = P1_SemCreate("Clock Hand", 1, &clockHand);
     assert(rc == P1_SUCCESS);
 
-    frameTable = (Frame*) malloc(sizeof(Frame) * frames);
+    // the frame descriptors were set up by P3FrameInit
+
+    for (i = 0; i < P1_MAXPROC; i++) {
+        residentSets[i].resident = 0;
+        residentSets[i].target = P3_swapOptions.initialTarget;
+        residentSets[i].lastFault = 0;
+    }
+
+    swapCache = (CachedSlot*) malloc(sizeof(CachedSlot) * P3_swapOptions.clusterCache);
+    for (i = 0; i < P3_swapOptions.clusterCache; i++) {
+        swapCache[i].slot = -1;
+        swapCache[i].data = malloc(pageSize);
+    }
+    rc = P1_SemCreate("Swap Cache", 1, &swapCacheSem);
+    assert(rc == P1_SUCCESS);
+
+    fastTier = (FastSlot*) malloc(sizeof(FastSlot) * P3_swapOptions.fastSlots);
+    for (i = 0; i < P3_swapOptions.fastSlots; i++) {
+        fastTier[i].slot = -1;
+        fastTier[i].data = malloc(pageSize);
+    }
+    rc = P1_SemCreate("Fast Tier", 1, &fastTierSem);
+    assert(rc == P1_SUCCESS);
+
+    rc = P1_SemCreate("IO Queue", 1, &ioQueueSem);
+    assert(rc == P1_SUCCESS);
+    rc = P1_SemCreate("IO Free", IO_REQUESTS, &ioFreeSem);
+    assert(rc == P1_SUCCESS);
+    for (i = 0; i < IO_REQUESTS; i++) {
+        char name[P1_MAXNAME+1];
+        snprintf(name, sizeof(name), "IO %d", i);
+        ioRequests[i].inUse = 0;
+        rc = P1_SemCreate(name, 0, &ioRequests[i].done);
+        assert(rc == P1_SUCCESS);
+    }
+    if (P3_swapOptions.elevator || P3_swapOptions.async) {
+        rc = P1_SemCreate("IO Done", 0, &ioDoneSem);
+        assert(rc == P1_SUCCESS);
+        ioRunning = 1;
+        for (int k = 0; k < unitsNum; k++) {
+            int unit = SWAP_UNIT(k);
+            char name[P1_MAXNAME+1];
+            ioUnits[unit].queue = NULL;
+            ioUnits[unit].depth = 0;
+            ioUnits[unit].head = 0;
+            ioUnits[unit].merge = P3ArenaAlloc(sectorNum * sectorByte);
+            snprintf(name, sizeof(name), "IO Pending %d", unit);
+            rc = P1_SemCreate(name, 0, &ioUnits[unit].pendingSem);
+            assert(rc == P1_SUCCESS);
+            int pid;
+            snprintf(name, sizeof(name), "IOScheduler %d", unit);
+            rc = P1_Fork(name, IOScheduler, (void *) (long) unit, USLOSS_MIN_STACK, P3_PAGER_PRIORITY, 0, &pid);
+            assert(rc == P1_SUCCESS);
+        }
+    }
 
-    for (i = 0; i < frames; i++) {
+    memset(P3_frames.age, 0, frames);
+    memset(&P3_swapStats, 0, sizeof(P3_swapStats));
 
-        frameTable[i].pid = -1;
-        frameTable[i].page = -1;
-        frameTable[i].busy = 0;
+    // the ager samples the reference bits so that P3SwapOut can pick the oldest frame
+    if (P3_swapOptions.replacement == P3_REPLACE_AGING) {
+        agerRunning = 1;
+        rc = P1_SemCreate("agerDone", 0, &agerDone);
+        assert(rc == P1_SUCCESS);
+        rc = P1_Fork("ager", Ager, NULL, USLOSS_MIN_STACK, P3_PAGER_PRIORITY, 0, &agerPid);
+        assert(rc == P1_SUCCESS);
+    }
 
+    if (P3_swapOptions.fastSlots > 0) {
+        migratorRunning = 1;
+        rc = P1_SemCreate("migratorDone", 0, &migratorDone);
+        assert(rc == P1_SUCCESS);
+        rc = P1_Fork("migrator", Migrator, NULL, USLOSS_MIN_STACK, P3_PAGER_PRIORITY, 0, &migratorPid);
+        assert(rc == P1_SUCCESS);
     }
 
-    rc = P1_SemCreate("Page Table", 1, &frameTableSem);
+    // compressed slots aren't blocks, there is nothing to compact
+    if (P3_swapOptions.compactInterval > 0 && !P3_swapOptions.compress) {
+        compactorRunning = 1;
+        rc = P1_SemCreate("compactorDone", 0, &compactorDone);
+        assert(rc == P1_SUCCESS);
+        rc = P1_Fork("compactor", Compactor, NULL, USLOSS_MIN_STACK, P3_PAGER_PRIORITY, 0, &compactorPid);
+        assert(rc == P1_SUCCESS);
+    }
 
     rc = P1_SemCreate("Vm Stats", 1, &vmStats);
     assert(rc == P1_SUCCESS);
@@ -202,8 +621,8 @@ P3SwapInit(int pages, int frames)
     rc = P1_P(vmStats);
     assert (rc == P1_SUCCESS);
 
-    P3_vmStats.blocks = swapTableSize;
-    P3_vmStats.freeBlocks = swapTableSize;
+    P3_vmStats.blocks = blocksNum;
+    P3_vmStats.freeBlocks = blocksNum;
     P3_vmStats.pageIns  = 0;
     P3_vmStats.pageOuts = 0;
     //P3_vmStats.replaced = 0;
@@ -233,7 +652,63 @@ P3SwapShutdown(void)
     if (!initialized)
         return P3_NOT_INITIALIZED;
 
-    free(swapTable);
+    // the ager, the migrator and the compactor notice this the next time they wake up and quit
+    agerRunning = 0;
+    migratorRunning = 0;
+    compactorRunning = 0;
+
+    // they use the locks and the I/O schedulers, so they must be gone before those are
+    if (agerPid != -1) {
+        rc = P1_P(agerDone);
+        assert(rc == P1_SUCCESS);
+        rc = P1_SemFree(agerDone);
+        assert(rc == P1_SUCCESS);
+    }
+    if (migratorPid != -1) {
+        rc = P1_P(migratorDone);
+        assert(rc == P1_SUCCESS);
+        rc = P1_SemFree(migratorDone);
+        assert(rc == P1_SUCCESS);
+    }
+    if (compactorPid != -1) {
+        rc = P1_P(compactorDone);
+        assert(rc == P1_SUCCESS);
+        rc = P1_SemFree(compactorDone);
+        assert(rc == P1_SUCCESS);
+    }
+
+    if (ioRunning) {
+        ioRunning = 0;
+        for (int k = 0; k < unitsNum; k++) {
+            int unit = SWAP_UNIT(k);
+            rc = P1_V(ioUnits[unit].pendingSem);
+            assert(rc == P1_SUCCESS);
+            rc = P1_P(ioDoneSem);
+            assert(rc == P1_SUCCESS);
+            rc = P1_SemFree(ioUnits[unit].pendingSem);
+            assert(rc == P1_SUCCESS);
+        }
+        rc = P1_SemFree(ioDoneSem);
+        assert(rc == P1_SUCCESS);
+        USLOSS_Console("P3SwapShutdown: I/O requests: %d, merged: %d, seek tracks: %d, max depth: %d, "
+            "avg depth: %d.%02d\n", P3_swapStats.ioRequests, P3_swapStats.ioMerges,
+            P3_swapStats.ioSeekTracks, P3_swapStats.ioMaxDepth,
+            P3_swapStats.ioRequests ? P3_swapStats.ioDepthSum / P3_swapStats.ioRequests : 0,
+            P3_swapStats.ioRequests ? (P3_swapStats.ioDepthSum * 100 / P3_swapStats.ioRequests) % 100 : 0);
+    }
+
+    rc = P1_SemFree(ioQueueSem);
+    assert(rc == P1_SUCCESS);
+    rc = P1_SemFree(ioFreeSem);
+    assert(rc == P1_SUCCESS);
+    for (i = 0; i < IO_REQUESTS; i++) {
+        rc = P1_SemFree(ioRequests[i].done);
+        assert(rc == P1_SUCCESS);
+    }
+
+    // the swap and frame tables and the pack buffers go with the VM arena
+    rc = P1_SemFree(packSem);
+    assert(rc == P1_SUCCESS);
     
     rc = P1_SemFree(swapTableSem);
     assert(rc == P1_SUCCESS);
@@ -241,13 +716,75 @@ P3SwapShutdown(void)
     rc = P1_SemFree(clockHand);
     assert(rc == P1_SUCCESS);
 
-    free(frameTable);
 
-    rc = P1_SemFree(frameTableSem);
+    for (i = 0; i < P3_swapOptions.clusterCache; i++) {
+        free(swapCache[i].data);
+    }
+    free(swapCache);
+
+    rc = P1_SemFree(swapCacheSem);
+    assert(rc == P1_SUCCESS);
+
+    for (i = 0; i < P3_swapOptions.fastSlots; i++) {
+        free(fastTier[i].data);
+    }
+    free(fastTier);
+
+    rc = P1_SemFree(fastTierSem);
     assert(rc == P1_SUCCESS);
 
+
     // clean things up
 
+    if (P3_swapOptions.replacement == P3_REPLACE_AGING) {
+        USLOSS_Console("P3SwapShutdown: aging samples: %d\n", P3_swapStats.agingSamples);
+    }
+    if (P3_swapOptions.cluster > 1) {
+        USLOSS_Console("P3SwapShutdown: cluster reads: %d, pages: %d, hits: %d, expired: %d\n",
+            P3_swapStats.clusterReads, P3_swapStats.clusterPages, P3_swapStats.clusterHits,
+            P3_swapStats.clusterExpired);
+    }
+    if (P3_swapStats.prepagePages > 0) {
+        USLOSS_Console("P3SwapShutdown: prepaged pages: %d, reads: %d\n",
+            P3_swapStats.prepagePages, P3_swapStats.prepageReads);
+    }
+    if (P3_swapOptions.local) {
+        USLOSS_Console("P3SwapShutdown: local victims: %d, target grows: %d, target shrinks: %d\n",
+            P3_swapStats.localVictims, P3_swapStats.targetGrows, P3_swapStats.targetShrinks);
+    }
+    if (P3_swapOptions.extents) {
+        USLOSS_Console("P3SwapShutdown: extents: %d, placed: %d, misplaced: %d\n",
+            P3_swapStats.extentsReserved, P3_swapStats.extentPlaced, P3_swapStats.extentMisses);
+    }
+    if (compactorPid != -1) {
+        USLOSS_Console("P3SwapShutdown: compaction passes: %d, slots moved: %d\n",
+            P3_swapStats.compactPasses, P3_swapStats.compactMoves);
+    }
+    if ((P3_swapOptions.extents || compactorPid != -1) && P3_swapStats.fragProcesses > 0) {
+        USLOSS_Console("P3SwapShutdown: avg slots per run: %d.%02d, worst free runs: %d, "
+            "worst largest free run: %d\n",
+            P3_swapStats.fragSlots / P3_swapStats.fragRuns,
+            (P3_swapStats.fragSlots * 100 / P3_swapStats.fragRuns) % 100,
+            P3_swapStats.freeRunsMax, P3_swapStats.largestFreeMin);
+    }
+    if (P3_swapOptions.compress) {
+        USLOSS_Console("P3SwapShutdown: packed pages: %d, pack writes: %d, pack reads: %d, uncompressed: %d\n",
+            P3_swapStats.packedPages, P3_swapStats.packWrites, P3_swapStats.packReads,
+            P3_swapStats.unpackedPages);
+    }
+    if (P3_swapOptions.fastSlots > 0) {
+        USLOSS_Console("P3SwapShutdown: fast tier puts: %d, hits: %d, demotions: %d, slow tier hits: %d\n",
+            P3_swapStats.fastPuts, P3_swapStats.fastHits, P3_swapStats.fastDemotions,
+            P3_swapStats.slowHits);
+    }
+    if (unitsNum > 1) {
+        for (int k = 0; k < unitsNum; k++) {
+            int unit = SWAP_UNIT(k);
+            USLOSS_Console("P3SwapShutdown: unit %d slots: %d, I/Os: %d\n", unit, unitSlots,
+                P3_swapStats.unitIOs[unit]);
+        }
+    }
+
     return P1_SUCCESS;
 }
 
@@ -278,44 +815,62 @@ P3SwapFreeAll(int pid)
     //P(mutex)
     rc = P1_P(swapTableSem);
     assert(rc == P1_SUCCESS);
+
+    // measuring fragmentation scans the whole swap table, only do it if it is reported
+    if (P3_swapOptions.extents || P3_swapOptions.compactInterval > 0) {
+        SwapFragmentation(pid);
+    }
+
+    for (int g = 0; g < extentGroups; g++) {
+        if (processExtents[pid][g] != -1) {
+            extentOwner[processExtents[pid][g]] = -1;
+        }
+        processExtents[pid][g] = -1;
+    }
     
     //free all swap space used by the process
-    for (i = 0; i < swapTableSize ;i++) {
-        if (swapTable[i].pid == pid) {
-            
-            swapTable[i].pid  = -1;
-            swapTable[i].page = -1;
-            swapTable[i].allocated = -1;
-            rc = P1_P(vmStats);
+    while (ownedSlots[pid] != -1) {
+        i = ownedSlots[pid];
+        CacheDrop(i);
+        FastDrop(i);
+        SlotOwn(i, -1, -1);
+        swapTable[i].allocated = -1;
+
+        if (P3_swapOptions.compress) {
+            rc = P1_P(packSem);
+            assert(rc == P1_SUCCESS);
+            PackRemove(i);
+            if (swapTable[i].block != -1) {
+                BlockFree(swapTable[i].block);
+                swapTable[i].block = -1;
+            }
+            rc = P1_V(packSem);
             assert(rc == P1_SUCCESS);
+            continue;
+        }
 
-            P3_vmStats.freeBlocks += 1;
+        rc = P1_P(vmStats);
+        assert(rc == P1_SUCCESS);
 
-            rc = P1_V(vmStats);
-            assert(rc == P1_SUCCESS);
+        P3_vmStats.freeBlocks += 1;
 
-        }
+        rc = P1_V(vmStats);
+        assert(rc == P1_SUCCESS);
     }
     
     //V(mutex)
     rc = P1_V(swapTableSem);
     assert(rc == P1_SUCCESS);
 
-    rc = P1_P(frameTableSem);
+    // the process's frames are freed by P3FrameFreeAll
+    rc = P1_P(P3_frames.sem);
     assert(rc == P1_SUCCESS);
 
-    for (i = 0; i < framesNum; i++) {
-
-        if(frameTable[i].pid == pid) {
-
-            frameTable[i].pid = -1;
-            frameTable[i].page = -1;
-            frameTable[i].busy = 0;
-        }
-
-    }
+    residentSets[pid].resident = 0;
+    residentSets[pid].target = P3_swapOptions.initialTarget;
+    residentSets[pid].lastFault = 0;
 
-    rc = P1_V(frameTableSem);
+    rc = P1_V(P3_frames.sem);
     assert(rc == P1_SUCCESS);
 
     return P1_SUCCESS;
@@ -338,10 +893,36 @@ P3SwapFreeAll(int pid)
  */
 int
 P3SwapOut(int *frame) 
+{
+    int io;
+
+    int result = P3SwapOutStart(frame, &io);
+    if (result == P1_SUCCESS && io != -1) {
+        result = P3SwapFinish(io);
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3SwapOutStart --
+ *
+ * Like P3SwapOut, but only starts the write of a dirty page. The page is copied out first, so
+ * the frame can be used as soon as P3SwapOutStart returns. The write is returned in *io, -1 if
+ * the page wasn't dirty, and must be passed to P3SwapFinish.
+ *
+ * Results:
+ *   P3_NOT_INITIALIZED:    P3SwapInit has not been called
+ *   P1_SUCCESS:            success
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3SwapOutStart(int *frame, int *io)
 {
 
     int target;
-    int access;
     if (!initialized)
         return P3_NOT_INITIALIZED;
 
@@ -349,89 +930,48 @@ P3SwapOut(int *frame)
     rc = P1_P(clockHand);
     assert(rc == P1_SUCCESS);
 
-    while(1) {
-        
-        hand = (hand + 1) % P3_vmStats.frames;
-        if (!frameTable[hand].busy) {
-            rc = USLOSS_MmuGetAccess(hand,&access);
-            assert(rc == USLOSS_MMU_OK);
-
-            int bit = access & USLOSS_MMU_REF;
-            if (!bit) {
-                
-                //frameTable[hand].busy = 1;
-                target = hand;
+    // in local mode only consider frames of processes that are over their target, if any
+    int local = 0;
+    if (P3_swapOptions.local) {
+        for (int f = 0; f < framesNum; f++) {
+            if (!(P3_frames.flags[f] & P3_FRAME_BUSY) && OverTarget(f)) {
+                local = 1;
                 break;
-            } else {
-                access &= ~USLOSS_MMU_REF;
-                rc = USLOSS_MmuSetAccess(hand, access);
-                assert(rc == USLOSS_MMU_OK);
             }
         }
-    } // while
-
-    USLOSS_Console("SwapOut: %d\n", target);
-
-    int pid = frameTable[target].pid;
-    int page = frameTable[target].page;
-
-    rc = USLOSS_MmuGetAccess(target,&access);
-    assert(rc == USLOSS_MMU_OK);
-    if (access & USLOSS_MMU_DIRTY) {
-
-        for (i = 0; i < swapTableSize; i++) {
-            if (swapTable[i].pid == pid &&
-                    swapTable[i].page == page) {
-
-                void *addr;
-                rc = P3FrameMap(target, &addr);
-                assert(rc == P1_SUCCESS);
-
-                void *tempAddr = malloc(pageSize);
-                memcpy(tempAddr, addr, pageSize);
-            
-                USLOSS_Console("writing to disk in %d\n",i);
-                rc = P2_DiskWrite(P3_SWAP_DISK, getTrack(i), getSector(i), sectorInPage, tempAddr);
-                                
-                assert(rc == P1_SUCCESS);
-
-                free(tempAddr);
-
-                rc = P3FrameUnmap(target);
-                assert(rc == P1_SUCCESS);
-
-                swapTable[i].allocated = 1;
-
-                rc = P1_P(vmStats);
-                assert(rc == P1_SUCCESS);
-
-                P3_vmStats.pageOuts += 1;
-                //P3_vmStats.replaced += 1;
-
-                rc = P1_V(vmStats);
-                assert(rc == P1_SUCCESS);
- 
-                access = access & ~USLOSS_MMU_DIRTY;
-                rc = USLOSS_MmuSetAccess(target, USLOSS_MMU_DIRTY);
-                assert(rc == USLOSS_MMU_OK);
+    }
 
-            }
+    // every frame can be busy being claimed or read, then wait for one to be mapped
+    while (1) {
+        if (P3_swapOptions.replacement == P3_REPLACE_AGING) {
+            target = AgingSelect(local);
+        } else {
+            target = ClockSelect(local);
+        }
+        if (target != -1) {
+            break;
+        }
+        if (local) {
+            local = 0;
+        } else {
+            FrameWait();
         }
-
+    }
+    if (local) {
+        P3_swapStats.localVictims++;
     }
 
-
-    USLOSS_PTE *pageTable;
-    rc = P3PageTableGet(pid, &pageTable);
+    // the victim is the caller's until the frame layer maps a page to it
+    rc = P1_P(P3_frames.sem);
+    assert(rc == P1_SUCCESS);
+    P3_frames.flags[target] |= P3_FRAME_BUSY;
+    rc = P1_V(P3_frames.sem);
     assert(rc == P1_SUCCESS);
 
-    pageTable[frameTable[target].page].incore = 0;
-    //pageTable[i].frame = -1;
+    debug3("SwapOut: %d\n", target);
 
-    // rc = P3PageTableSet(pid, pageTable);
-    // assert(rc == P1_SUCCESS);
+    *io = EvictStart(target);
 
-    frameTable[target].busy = 1;
     rc = P1_V(clockHand);
     assert(rc == P1_SUCCESS);
 
@@ -471,6 +1011,53 @@ P3SwapOut(int *frame)
 
     return P1_SUCCESS;
 }
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3SwapOutProcess --
+ *
+ * Evicts every page the process has in a frame, writing dirty pages out to swap. Used by
+ * load control to take all of a suspended process's frames at once. The frames that were
+ * freed are returned in frames, which must have room for every frame, and their number in
+ * *count. Busy frames are skipped.
+ *
+ * Results:
+ *   P3_NOT_INITIALIZED:    P3SwapInit has not been called
+ *   P1_INVALID_PID:        pid is invalid
+ *   P1_SUCCESS:            success
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3SwapOutProcess(PID pid, int *frames, int *count)
+{
+    if (!initialized)
+        return P3_NOT_INITIALIZED;
+
+    if (pid < 0 || pid >= P1_MAXPROC)
+        return P1_INVALID_PID;
+
+    *count = 0;
+
+    rc = P1_P(clockHand);
+    assert(rc == P1_SUCCESS);
+
+    for (int f = 0; f < framesNum; f++) {
+        if (P3_frames.pid[f] != pid || (P3_frames.flags[f] & P3_FRAME_BUSY)) {
+            continue;
+        }
+        // the frame layer gives the frame up when it frees it
+        Evict(f);
+        P3_frames.age[f] = 0;
+        frames[(*count)++] = f;
+    }
+
+    rc = P1_V(clockHand);
+    assert(rc == P1_SUCCESS);
+
+    return P1_SUCCESS;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -492,8 +1079,37 @@ P3SwapOut(int *frame)
 int
 P3SwapIn(int pid, int page, int frame)
 {
+    int io;
+
+    int result = P3SwapInStart(pid, page, frame, &io);
+    if (io != -1) {
+        rc = P3SwapFinish(io);
+        assert(rc == P1_SUCCESS);
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3SwapInStart --
+ *
+ *  Like P3SwapIn, but only starts the read of a page that is on the
+ *  swap disk. The read is returned in *io, -1 if the page was not
+ *  read from the disk, and must be passed to P3SwapFinish before the
+ *  frame is used. The caller keeps the frame busy until it maps it.
+ *
+ * Results:
+ *   Same as P3SwapIn.
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3SwapInStart(PID pid, int page, int frame, int *io)
+{
+    *io = -1;
 
-    USLOSS_Console("SwapIn: %d %d %d\n", pid, page, frame);
+    debug3("SwapIn: %d %d %d\n", pid, page, frame);
 
     int result = P1_SUCCESS;
 
@@ -510,6 +1126,7 @@ P3SwapIn(int pid, int page, int frame)
         return P3_INVALID_FRAME;
 
     int found = 0;
+    int slot = -1;
 
     rc = P1_P(swapTableSem);
     assert(rc == P1_SUCCESS);
@@ -522,28 +1139,46 @@ P3SwapIn(int pid, int page, int frame)
                 swapTable[i].page == page) {
             
             found = 1;
+            slot = i;
 
             if (swapTable[i].allocated) {
             
                 void* addr;
                 rc = P3FrameMap(frame,&addr);
                 assert(rc == P1_SUCCESS);
-
-                void* tempAddr = malloc(pageSize);
-                memcpy(tempAddr, addr, pageSize);
-
-                USLOSS_Console("Disk Reading: %d %d %d\n",pid, page, frame);
-                rc = P2_DiskRead(P3_SWAP_DISK, getTrack(i), getSector(i), sectorInPage, tempAddr);
-                memcpy(addr, tempAddr, pageSize);
-                assert(rc == P1_SUCCESS);
-                free(tempAddr);
-
-                rc = P1_P(vmStats);
-                assert(rc == P1_SUCCESS);
-                P3_vmStats.pageIns += 1;
-                rc = P1_V(vmStats);
-                assert(rc == P1_SUCCESS);
-
+                void* tempAddr = P3SlabAlloc(P3_SLAB_PAGE);
+                if (FastGet(i, tempAddr) || IOForward(i, tempAddr) || CacheTake(i, tempAddr)) {
+                    // in the fast tier, still being written out, or read along with a
+                    // neighbouring slot, no need to go to the disk
+                    memcpy(addr, tempAddr, pageSize);
+                    P3SlabFree(P3_SLAB_PAGE, tempAddr);
+                } else if (swapTable[i].pack != -1) {
+                    PackRead(i, addr);
+                    P3SlabFree(P3_SLAB_PAGE, tempAddr);
+                    P3_swapStats.slowHits++;
+
+                    rc = P1_P(vmStats);
+                    assert(rc == P1_SUCCESS);
+                    P3_vmStats.pageIns += 1;
+                    rc = P1_V(vmStats);
+                    assert(rc == P1_SUCCESS);
+                } else {
+                    int cluster = ClusterLength(i, pid);
+                    int slab = P3_SLAB_PAGE;
+                    if (cluster > 1) {
+                        P3SlabFree(P3_SLAB_PAGE, tempAddr);
+                        tempAddr = P3SlabAlloc(P3_SLAB_CLUSTER);
+                        slab = P3_SLAB_CLUSTER;
+                    }
+                    int block = swapTable[i].block;
+                    debug3("Disk Reading: %d %d %d\n", pid, page, frame);
+                    *io = IOSubmit(0, getUnit(block), getTrack(block), getSector(block),
+                                   cluster * sectorInPage, tempAddr, i, slab);
+                    ioRequests[*io].frame = frame;
+                    ioRequests[*io].cluster = cluster;
+                    ioRequests[*io].stamp = slotWrites;
+                    P3_swapStats.slowHits++;
+                }
                 rc = P3FrameUnmap(frame);
                 assert(rc == P1_SUCCESS);
                 flag = 1;
@@ -557,17 +1192,23 @@ P3SwapIn(int pid, int page, int frame)
 
         if (!found) {
 
-            if (P3_vmStats.freeBlocks > 0) {
+            // compressed pages get a block when they are written, keep enough blocks for
+            // every frame in case none of them compress
+            int reserve = P3_swapOptions.compress ? framesNum : 0;
+            result = P3_OUT_OF_SWAP;
 
-                for (i = 0 ; i < swapTableSize; i++) {
-                    if (swapTable[i].pid == -1) {
+            if (P3_vmStats.freeBlocks > reserve) {
+
+                i = SlotAlloc(pid, page);
+                if (i != -1) {
+                    slot = i;
                 
-                        swapTable[i].pid       = pid;
-                        swapTable[i].page      = page;
-                        swapTable[i].allocated = 0;
-                        
-                        result =  P3_EMPTY_PAGE;
+                    SlotOwn(i, pid, page);
+                    swapTable[i].allocated = 0;
+                    
+                    result =  P3_EMPTY_PAGE;
 
+                    if (!P3_swapOptions.compress) {
                         rc = P1_P(vmStats);
                         assert(rc == P1_SUCCESS);
 
@@ -575,12 +1216,9 @@ P3SwapIn(int pid, int page, int frame)
 
                         rc = P1_V(vmStats);
                         assert(rc == P1_SUCCESS);
-                        break;
-                    }   
+                    }
                 }
 
-            } else {
-                result = P3_OUT_OF_SWAP;
             }
 
         } else {
@@ -588,14 +1226,13 @@ P3SwapIn(int pid, int page, int frame)
         }
     }
 
-    rc = P1_P(frameTableSem);
+    rc = P1_P(P3_frames.sem);
     assert(rc == P1_SUCCESS);
     
-    frameTable[frame].pid  = pid;
-    frameTable[frame].page = page;
-    frameTable[frame].busy = 0;
+    FrameAssign(frame, pid, page, slot);
+    ResidentSetFault(pid);
    
-    rc = P1_V(frameTableSem);
+    rc = P1_V(P3_frames.sem);
     assert(rc == P1_SUCCESS);
     
     
@@ -626,14 +1263,1825 @@ P3SwapIn(int pid, int page, int frame)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3SwapFinish --
+ *
+ *  Waits for a write started by P3SwapOutStart or a read started by
+ *  P3SwapInStart to complete. A read is copied into its frame. Several reads and writes can be outstanding and
+ *  they can be finished in any order.
+ *
+ * Results:
+ *   P3_NOT_INITIALIZED:    P3SwapInit has not been called
+ *   P1_SUCCESS:            success
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3SwapFinish(int io)
+{
+    if (!initialized)
+        return P3_NOT_INITIALIZED;
+
+    assert(io >= 0 && io < IO_REQUESTS && ioRequests[io].inUse);
+    IORequest *req = &ioRequests[io];
+
+    rc = IOWait(io);
+    assert(rc == P1_SUCCESS);
+
+    if (req->write) {
+        rc = P1_P(vmStats);
+        assert(rc == P1_SUCCESS);
+        P3_vmStats.pageOuts += 1;
+        rc = P1_V(vmStats);
+        assert(rc == P1_SUCCESS);
+    } else {
+        void *addr;
+        rc = P3FrameMap(req->frame, &addr);
+        assert(rc == P1_SUCCESS);
+        memcpy(addr, req->buffer, pageSize);
+        rc = P3FrameUnmap(req->frame);
+        assert(rc == P1_SUCCESS);
+
+        // a slot that was written, moved or freed while the read was in flight is stale
+        rc = P1_P(swapTableSem);
+        assert(rc == P1_SUCCESS);
+        for (int n = 1; n < req->cluster; n++) {
+            if (swapTable[req->slot + n].written <= req->stamp) {
+                CachePut(req->slot + n, req->buffer + n * pageSize);
+            }
+        }
+        rc = P1_V(swapTableSem);
+        assert(rc == P1_SUCCESS);
+        if (req->cluster > 1) {
+            P3_swapStats.clusterReads++;
+            P3_swapStats.clusterPages += req->cluster - 1;
+        }
+
+        rc = P1_P(vmStats);
+        assert(rc == P1_SUCCESS);
+        P3_vmStats.pageIns += 1;
+        rc = P1_V(vmStats);
+        assert(rc == P1_SUCCESS);
+    }
+
+    IOFree(io);
+    return P1_SUCCESS;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClockSelect --
+ *
+ *  Runs the clock algorithm to pick a frame to replace. If local is
+ *  set only frames of processes over their resident set target are
+ *  considered. Caller must hold the clockHand mutex.
+ *
+ * Results:
+ *   The selected frame, -1 if every frame considered is busy.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ClockSelect(int local)
+{
+    int target = -1;
+    int access;
+
+    // the first sweep clears the reference bits, so two find a frame if there is one
+    for (int n = 0; n < 2 * P3_vmStats.frames; n++) {
+        
+        hand = (hand + 1) % P3_vmStats.frames;
+        if (!(P3_frames.flags[hand] & P3_FRAME_BUSY) && (!local || OverTarget(hand))) {
+            rc = USLOSS_MmuGetAccess(hand,&access);
+            assert(rc == USLOSS_MMU_OK);
+
+            int bit = access & USLOSS_MMU_REF;
+            if (!bit) {
+                target = hand;
+                break;
+            } else {
+                access &= ~USLOSS_MMU_REF;
+                rc = USLOSS_MmuSetAccess(hand, access);
+                assert(rc == USLOSS_MMU_OK);
+            }
+        }
+    }
+
+    return target;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AgingSelect --
+ *
+ *  Picks the non-busy frame with the smallest age. A reference bit that
+ *  was set since the last sample counts as the age the frame will have
+ *  after the next sample. Ties are broken by starting the scan one past
+ *  the hand so that equally old frames are replaced round-robin. If
+ *  local is set only frames of processes over their resident set target
+ *  are considered. Caller must hold the clockHand mutex.
+ *
+ * Results:
+ *   The selected frame, -1 if every frame considered is busy.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+AgingSelect(int local)
+{
+    int target = -1;
+    int best = 0x100;
+    int access;
+
+    for (int n = 1; n <= framesNum; n++) {
+        int f = (hand + n) % framesNum;
+        if ((P3_frames.flags[f] & P3_FRAME_BUSY) || (local && !OverTarget(f))) {
+            continue;
+        }
+        rc = USLOSS_MmuGetAccess(f, &access);
+        assert(rc == USLOSS_MMU_OK);
+
+        int age = P3_frames.age[f] >> 1;
+        if (access & USLOSS_MMU_REF) {
+            age |= AGE_REFERENCED;
+        }
+        if (age < best) {
+            best = age;
+            target = f;
+            if (age == 0) {
+                break;
+            }
+        }
+    }
+    if (target != -1) {
+        hand = target;
+    }
+    return target;
+}
+
+/*
+ * Waits until a busy frame stops being busy. The clockHand mutex is released while waiting.
+ * Caller must hold it.
+ */
+static void
+FrameWait(void)
+{
+    int idle = 0;
+
+    // a frame may have stopped being busy since the caller looked
+    rc = P1_P(P3_frames.sem);
+    assert(rc == P1_SUCCESS);
+    for (int f = 0; f < framesNum && !idle; f++) {
+        idle = !(P3_frames.flags[f] & P3_FRAME_BUSY);
+    }
+    if (!idle) {
+        P3_frames.waiters++;
+    }
+    rc = P1_V(P3_frames.sem);
+    assert(rc == P1_SUCCESS);
+
+    if (!idle) {
+        rc = P1_V(clockHand);
+        assert(rc == P1_SUCCESS);
+        rc = P1_P(P3_frames.idle);
+        assert(rc == P1_SUCCESS);
+        rc = P1_P(clockHand);
+        assert(rc == P1_SUCCESS);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EvictStart --
+ *
+ *  Starts writing the page in the frame to its swap slot if it is
+ *  dirty, or puts it in the fast tier if there is one, and updates the
+ *  owner's page table so the page is no longer in the frame. The page is copied out before EvictStart returns, so
+ *  the frame can be reused right away. Caller must hold the clockHand
+ *  mutex.
+ *
+ * Results:
+ *   The write to pass to P3SwapFinish, -1 if nothing was written. With
+ *   the fast tier it is the write of the slot demoted to make room.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+EvictStart(int target)
+{
+    int access;
+    int io = -1;
+    int pid = P3_frames.pid[target];
+    int page = P3_frames.page[target];
+
+    if (pid == -1) {
+        return -1;
+    }
+    residentSets[pid].resident--;
+
+    rc = USLOSS_MmuGetAccess(target,&access);
+    assert(rc == USLOSS_MMU_OK);
+    if (access & USLOSS_MMU_DIRTY) {
+
+        // the frame's slot back-pointer is stale if the compactor moved the page since
+        int first = P3_frames.slot[target];
+        if (first == -1 || swapTable[first].pid != pid || swapTable[first].page != page) {
+            first = 0;
+        }
+        for (int slot = first; slot < swapTableSize; slot++) {
+            if (swapTable[slot].pid == pid &&
+                    swapTable[slot].page == page) {
+
+                void *addr;
+                rc = P3FrameMap(target, &addr);
+                assert(rc == P1_SUCCESS);
+
+                void *tempAddr = P3SlabAlloc(P3_SLAB_PAGE);
+                memcpy(tempAddr, addr, pageSize);
+
+                rc = P3FrameUnmap(target);
+                assert(rc == P1_SUCCESS);
+            
+                CacheDrop(slot);
+
+                // a swap-in of the page before the write completes gets it from tempAddr
+                swapTable[slot].allocated = 1;
+
+                if (P3_swapOptions.fastSlots > 0) {
+                    io = FastPut(slot, tempAddr);
+                    P3SlabFree(P3_SLAB_PAGE, tempAddr);
+                } else {
+                    io = SlotWrite(slot, tempAddr);
+                }
+ 
+                access = access & ~USLOSS_MMU_DIRTY;
+                rc = USLOSS_MmuSetAccess(target, access);
+                assert(rc == USLOSS_MMU_OK);
+                break;
+            }
+        }
+
+    }
+
+    // every page mapped to the frame loses it, not only the owner's
+    int unmapped;
+    rc = P3PageTableUnmapFrame(target, &unmapped);
+    assert(rc == P1_SUCCESS);
+    return io;
+}
+
+/*
+ * Like EvictStart, but waits for the write to complete.
+ */
+static void
+Evict(int target)
+{
+    int io = EvictStart(target);
+    if (io != -1) {
+        rc = P3SwapFinish(io);
+        assert(rc == P1_SUCCESS);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClusterLength --
+ *
+ *  Counts how many slots, starting with this one, can be read in one
+ *  P2_DiskRead. The slots that follow must be on the same unit and
+ *  track, right after it, hold
+ *  pages of the same process that are on the disk but not in a frame,
+ *  and not be cached, in the fast tier or being written already.
+ *  Caller must hold swapTableSem.
+ *
+ * Results:
+ *   The number of slots, between 1 and P3_swapOptions.cluster.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ClusterLength(int slot, PID pid)
+{
+    USLOSS_PTE pte;
+    int n;
+
+    // the slots that follow aren't the blocks that follow
+    if (P3_swapOptions.compress) {
+        return 1;
+    }
+
+    for (n = 1; n < P3_swapOptions.cluster && Contiguous(slot, n); n++) {
+        SwapSpace *next = &swapTable[slot + n];
+        if (next->pid != pid || next->allocated != 1) {
+            break;
+        }
+        rc = P3PageTableLookup(pid, next->page, &pte);
+        if (rc != P1_SUCCESS || pte.incore) {
+            break;
+        }
+        rc = P1_P(ioQueueSem);
+        assert(rc == P1_SUCCESS);
+        int writing = 0;
+        for (int io = 0; io < IO_REQUESTS; io++) {
+            if (ioRequests[io].inUse && ioRequests[io].write && ioRequests[io].slot == slot + n) {
+                writing = 1;
+            }
+        }
+        rc = P1_V(ioQueueSem);
+        assert(rc == P1_SUCCESS);
+        if (writing || FastHas(slot + n)) {
+            break;
+        }
+        rc = P1_P(swapCacheSem);
+        assert(rc == P1_SUCCESS);
+        int cached = 0;
+        for (int e = 0; e < P3_swapOptions.clusterCache; e++) {
+            if (swapCache[e].slot == slot + n) {
+                cached = 1;
+            }
+        }
+        rc = P1_V(swapCacheSem);
+        assert(rc == P1_SUCCESS);
+        if (cached) {
+            break;
+        }
+    }
+    return n;
+}
+
+/*
+ * Keeps a copy of a slot that was read as part of a cluster. Replaces an empty entry if there
+ * is one, otherwise the oldest entry.
+ */
+static void
+CachePut(int slot, void *data)
+{
+    int victim = -1;
+
+    rc = P1_P(swapCacheSem);
+    assert(rc == P1_SUCCESS);
+    for (int e = 0; e < P3_swapOptions.clusterCache; e++) {
+        if (swapCache[e].slot == -1) {
+            victim = e;
+            break;
+        }
+        if (victim == -1 || swapCache[e].when < swapCache[victim].when) {
+            victim = e;
+        }
+    }
+    if (victim != -1) {
+        if (swapCache[victim].slot != -1) {
+            P3_swapStats.clusterExpired++;
+        }
+        swapCache[victim].slot = slot;
+        rc = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &swapCache[victim].when);
+        assert(rc == USLOSS_DEV_OK);
+        memcpy(swapCache[victim].data, data, pageSize);
+    }
+    rc = P1_V(swapCacheSem);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Copies a cached slot into data and removes it from the cache. Entries older than
+ * clusterTTL are dropped instead.
+ *
+ * Returns TRUE if the slot was in the cache.
+ */
+static int
+CacheTake(int slot, void *data)
+{
+    int found = FALSE;
+    int now;
+
+    rc = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &now);
+    assert(rc == USLOSS_DEV_OK);
+
+    rc = P1_P(swapCacheSem);
+    assert(rc == P1_SUCCESS);
+    for (int e = 0; e < P3_swapOptions.clusterCache; e++) {
+        if (swapCache[e].slot != slot) {
+            continue;
+        }
+        if (now - swapCache[e].when <= P3_swapOptions.clusterTTL) {
+            memcpy(data, swapCache[e].data, pageSize);
+            P3_swapStats.clusterHits++;
+            found = TRUE;
+        } else {
+            P3_swapStats.clusterExpired++;
+        }
+        swapCache[e].slot = -1;
+        break;
+    }
+    rc = P1_V(swapCacheSem);
+    assert(rc == P1_SUCCESS);
+    return found;
+}
+
+/*
+ * Removes a slot from the cache because its contents are changing or going away, and
+ * stamps the slot so a cluster read that is in flight doesn't cache it again.
+ */
+static void
+CacheDrop(int slot)
+{
+    swapTable[slot].written = ++slotWrites;
+    rc = P1_P(swapCacheSem);
+    assert(rc == P1_SUCCESS);
+    for (int e = 0; e < P3_swapOptions.clusterCache; e++) {
+        if (swapCache[e].slot == slot) {
+            swapCache[e].slot = -1;
+        }
+    }
+    rc = P1_V(swapCacheSem);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Puts a page that is being evicted in the fast tier. Replaces the slot's entry if it has one,
+ * otherwise an empty entry, otherwise demotes the least recently used entry to make room.
+ * Returns the demoted entry's write for the caller to pass to P3SwapFinish once it has let
+ * go of its locks, -1 if there wasn't one.
+ */
+static int
+FastPut(int slot, void *data)
+{
+    int victim = -1;
+    int io = -1;
+
+    rc = P1_P(fastTierSem);
+    assert(rc == P1_SUCCESS);
+    for (int e = 0; e < P3_swapOptions.fastSlots; e++) {
+        if (fastTier[e].slot == slot) {
+            victim = e;
+            break;
+        }
+        if (victim == -1 || (fastTier[victim].slot != -1 &&
+                (fastTier[e].slot == -1 || fastTier[e].when < fastTier[victim].when))) {
+            victim = e;
+        }
+    }
+    if (fastTier[victim].slot != -1 && fastTier[victim].slot != slot) {
+        io = FastDemote(victim);
+    }
+    fastTier[victim].slot = slot;
+    rc = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &fastTier[victim].when);
+    assert(rc == USLOSS_DEV_OK);
+    memcpy(fastTier[victim].data, data, pageSize);
+    P3_swapStats.fastPuts++;
+    rc = P1_V(fastTierSem);
+    assert(rc == P1_SUCCESS);
+    return io;
+}
+
+/*
+ * Copies a slot in the fast tier into data. The slot stays in the tier, and having been used
+ * it will be demoted later.
+ *
+ * Returns TRUE if the slot was in the fast tier.
+ */
+static int
+FastGet(int slot, void *data)
+{
+    int found = FALSE;
+
+    rc = P1_P(fastTierSem);
+    assert(rc == P1_SUCCESS);
+    for (int e = 0; e < P3_swapOptions.fastSlots; e++) {
+        if (fastTier[e].slot == slot) {
+            memcpy(data, fastTier[e].data, pageSize);
+            rc = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &fastTier[e].when);
+            assert(rc == USLOSS_DEV_OK);
+            P3_swapStats.fastHits++;
+            found = TRUE;
+            break;
+        }
+    }
+    rc = P1_V(fastTierSem);
+    assert(rc == P1_SUCCESS);
+    return found;
+}
+
+/*
+ * Returns TRUE if the slot is in the fast tier, i.e. its copy on the disk is out of date.
+ */
+static int
+FastHas(int slot)
+{
+    int found = FALSE;
+
+    rc = P1_P(fastTierSem);
+    assert(rc == P1_SUCCESS);
+    for (int e = 0; e < P3_swapOptions.fastSlots; e++) {
+        if (fastTier[e].slot == slot) {
+            found = TRUE;
+            break;
+        }
+    }
+    rc = P1_V(fastTierSem);
+    assert(rc == P1_SUCCESS);
+    return found;
+}
+
+/*
+ * Removes a slot from the fast tier without writing it because it is going away.
+ */
+static void
+FastDrop(int slot)
+{
+    rc = P1_P(fastTierSem);
+    assert(rc == P1_SUCCESS);
+    for (int e = 0; e < P3_swapOptions.fastSlots; e++) {
+        if (fastTier[e].slot == slot) {
+            fastTier[e].slot = -1;
+        }
+    }
+    rc = P1_V(fastTierSem);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Starts writing a fast tier entry to its slot on the disk and empties it. Caller must hold
+ * fastTierSem. The write is started before the entry is emptied, so until it is done a
+ * swap-in of the slot gets the page from it with IOForward. Returns the write to pass to
+ * P3SwapFinish, -1 if the page was packed.
+ */
+static int
+FastDemote(int e)
+{
+    int slot = fastTier[e].slot;
+    void *data = P3SlabAlloc(P3_SLAB_PAGE);
+
+    memcpy(data, fastTier[e].data, pageSize);
+    int io = SlotWrite(slot, data);
+    fastTier[e].slot = -1;
+    P3_swapStats.fastDemotions++;
+    return io;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Migrator --
+ *
+ *  Every migrateInterval seconds demotes the slots in the fast tier
+ *  that haven't been written or read for demoteAge to the swap disk,
+ *  so the fast tier keeps room for pages that are being evicted and
+ *  faulted back in. The writes are waited for without holding
+ *  fastTierSem. Quits when P3SwapShutdown clears migratorRunning.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+Migrator(void *arg)
+{
+    while (1) {
+        rc = P2_Sleep(P3_swapOptions.migrateInterval);
+        assert(rc == P1_SUCCESS);
+
+        if (!migratorRunning) {
+            break;
+        }
+
+        int now;
+        rc = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &now);
+        assert(rc == USLOSS_DEV_OK);
+
+        for (int e = 0; e < P3_swapOptions.fastSlots; e++) {
+            int io = -1;
+            rc = P1_P(fastTierSem);
+            assert(rc == P1_SUCCESS);
+            if (fastTier[e].slot != -1 && now - fastTier[e].when > P3_swapOptions.demoteAge) {
+                io = FastDemote(e);
+            }
+            rc = P1_V(fastTierSem);
+            assert(rc == P1_SUCCESS);
+            if (io != -1) {
+                rc = P3SwapFinish(io);
+                assert(rc == P1_SUCCESS);
+            }
+        }
+    }
+    rc = P1_V(migratorDone);
+    assert(rc == P1_SUCCESS);
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Compactor --
+ *
+ *  Every compactInterval seconds moves up to compactBatch live slots
+ *  with CompactMove, stopping early when swap I/O is outstanding so
+ *  that it only uses the disk when the pagers don't. Quits when
+ *  P3SwapShutdown clears compactorRunning.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+Compactor(void *arg)
+{
+    while (1) {
+        rc = P2_Sleep(P3_swapOptions.compactInterval);
+        assert(rc == P1_SUCCESS);
+
+        if (!compactorRunning) {
+            break;
+        }
+
+        P3_swapStats.compactPasses++;
+        for (int moved = 0; moved < P3_swapOptions.compactBatch && compactorRunning; moved++) {
+            int idle = 1;
+
+            rc = P1_P(ioQueueSem);
+            assert(rc == P1_SUCCESS);
+            for (int io = 0; io < IO_REQUESTS; io++) {
+                if (ioRequests[io].inUse) {
+                    idle = 0;
+                }
+            }
+            rc = P1_V(ioQueueSem);
+            assert(rc == P1_SUCCESS);
+
+            if (!idle || !CompactMove()) {
+                break;
+            }
+        }
+    }
+    rc = P1_V(compactorDone);
+    assert(rc == P1_SUCCESS);
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompactMove --
+ *
+ *  Moves one live slot into the first free slot. The slot moved is
+ *  one past that hole that holds the next page of the process whose
+ *  page is just before the hole, if there is one, otherwise the last
+ *  live slot. Slots with outstanding I/O or a copy in the fast
+ *  tier are left alone, and with extents a slot is only moved into a
+ *  run that is free or reserved for its own process.
+ *
+ * Results:
+ *   TRUE if a slot was moved, FALSE if there was nothing to move.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+CompactMove(void)
+{
+    int moved = FALSE;
+
+    rc = P1_P(clockHand);
+    assert(rc == P1_SUCCESS);
+    rc = P1_P(swapTableSem);
+    assert(rc == P1_SUCCESS);
+
+    int hole = -1;
+    int src = -1;
+    for (int slot = 0; slot < swapTableSize && src == -1; slot++) {
+        if (swapTable[slot].pid != -1) {
+            continue;
+        }
+        hole = slot;
+        int last = -1;
+        int next = -1;
+        for (int s = swapTableSize - 1; s > hole; s--) {
+            SwapSpace *space = &swapTable[s];
+            if (space->pid == -1 || FastHas(s)) {
+                continue;
+            }
+            // a cluster read covers every slot from its first one
+            rc = P1_P(ioQueueSem);
+            assert(rc == P1_SUCCESS);
+            int busy = 0;
+            for (int io = 0; io < IO_REQUESTS; io++) {
+                IORequest *req = &ioRequests[io];
+                int span = req->cluster > 1 ? req->cluster : 1;
+                if (req->inUse && req->slot != -1 && req->slot <= s && s < req->slot + span) {
+                    busy = 1;
+                }
+            }
+            rc = P1_V(ioQueueSem);
+            assert(rc == P1_SUCCESS);
+            if (busy) {
+                continue;
+            }
+            if (P3_swapOptions.extents && extentOwner[hole / slotsPerTrack] != -1 &&
+                    extentOwner[hole / slotsPerTrack] != space->pid) {
+                continue;
+            }
+            if (last == -1) {
+                last = s;
+            }
+            if (hole > 0 && space->pid == swapTable[hole - 1].pid &&
+                    space->page == swapTable[hole - 1].page + 1) {
+                next = s;
+            }
+        }
+        src = next != -1 ? next : last;
+    }
+
+    PID pid = -1;
+    int page = -1;
+    int stamp = 0;
+    int onDisk = 0;
+    if (src != -1) {
+        pid = swapTable[src].pid;
+        page = swapTable[src].page;
+        stamp = swapTable[src].written;
+        onDisk = swapTable[src].allocated == 1;
+        compactHole = hole;
+    }
+
+    rc = P1_V(swapTableSem);
+    assert(rc == P1_SUCCESS);
+    rc = P1_V(clockHand);
+    assert(rc == P1_SUCCESS);
+
+    if (src == -1) {
+        return FALSE;
+    }
+
+    if (onDisk) {
+        char *buffer = P3SlabAlloc(P3_SLAB_PAGE);
+        rc = SwapDiskIO(0, getUnit(src), getTrack(src), getSector(src), sectorInPage, buffer);
+        assert(rc == P1_SUCCESS);
+        rc = SwapDiskIO(1, getUnit(hole), getTrack(hole), getSector(hole), sectorInPage, buffer);
+        assert(rc == P1_SUCCESS);
+        P3SlabFree(P3_SLAB_PAGE, buffer);
+    }
+
+    rc = P1_P(clockHand);
+    assert(rc == P1_SUCCESS);
+    rc = P1_P(swapTableSem);
+    assert(rc == P1_SUCCESS);
+
+    // the slot may have been written, moved or freed during the copy
+    compactHole = -1;
+    if (swapTable[src].written == stamp && swapTable[src].pid == pid &&
+            swapTable[src].page == page && (swapTable[src].allocated == 1) == onDisk) {
+        CacheDrop(src);
+        SlotOwn(hole, pid, page);
+        swapTable[hole].allocated = swapTable[src].allocated;
+        SlotOwn(src, -1, -1);
+        swapTable[src].allocated = 0;
+        P3_swapStats.compactMoves++;
+        moved = TRUE;
+    }
+
+    rc = P1_V(swapTableSem);
+    assert(rc == P1_SUCCESS);
+    rc = P1_V(clockHand);
+    assert(rc == P1_SUCCESS);
+    return moved;
+}
+
+/*
+ * Records that the slot holds the page of the process, moving it from its old owner's list
+ * of slots to the new owner's. A pid of -1 leaves it on no list. Caller must hold
+ * swapTableSem.
+ */
+static void
+SlotOwn(int slot, PID pid, int page)
+{
+    SwapSpace *space = &swapTable[slot];
+
+    if (space->pid != pid) {
+        if (space->pid != -1) {
+            if (space->prevOwned != -1) {
+                swapTable[space->prevOwned].nextOwned = space->nextOwned;
+            } else {
+                ownedSlots[space->pid] = space->nextOwned;
+            }
+            if (space->nextOwned != -1) {
+                swapTable[space->nextOwned].prevOwned = space->prevOwned;
+            }
+        }
+        space->prevOwned = -1;
+        space->nextOwned = -1;
+        if (pid != -1) {
+            space->nextOwned = ownedSlots[pid];
+            if (space->nextOwned != -1) {
+                swapTable[space->nextOwned].prevOwned = slot;
+            }
+            ownedSlots[pid] = slot;
+        }
+    }
+    space->pid = pid;
+    space->page = page;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SlotAlloc --
+ *
+ *  Picks a free slot for a process's page. With extents the page goes
+ *  at its offset in the run reserved for its group of pages, and the
+ *  run is reserved if the group doesn't have one yet. Otherwise, or if
+ *  that slot is taken, the first free slot is used. Caller must hold
+ *  swapTableSem.
+ *
+ * Results:
+ *   The slot, -1 if there is no free slot.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+SlotAlloc(PID pid, int page)
+{
+    // compressed slots aren't blocks, so their order doesn't matter
+    if (P3_swapOptions.extents && !P3_swapOptions.compress) {
+        int group = page / slotsPerTrack;
+        int e = processExtents[pid][group];
+
+        if (e == -1) {
+            for (int x = 0; x < extentsNum && e == -1; x++) {
+                if (extentOwner[x] != -1) {
+                    continue;
+                }
+                int n;
+                for (n = 0; n < slotsPerTrack && SlotFree(x * slotsPerTrack + n); n++)
+                    ;
+                if (n == slotsPerTrack) {
+                    e = x;
+                }
+            }
+            if (e != -1) {
+                extentOwner[e] = pid;
+                processExtents[pid][group] = e;
+                P3_swapStats.extentsReserved++;
+            }
+        }
+        if (e != -1 && SlotFree(e * slotsPerTrack + page % slotsPerTrack)) {
+            P3_swapStats.extentPlaced++;
+            return e * slotsPerTrack + page % slotsPerTrack;
+        }
+        P3_swapStats.extentMisses++;
+    }
+
+    for (int slot = 0; slot < swapTableSize; slot++) {
+        if (SlotFree(slot)) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Returns true if the slot is free and the compactor isn't copying a page into it.
+ */
+static int
+SlotFree(int slot)
+{
+    return swapTable[slot].pid == -1 && slot != compactHole;
+}
+
+/*
+ * Adds how fragmented a process's swap space is, and how fragmented the free space is, to the
+ * fragmentation stats. Called before the process's slots are freed. Caller must hold
+ * swapTableSem.
+ */
+static void
+SwapFragmentation(PID pid)
+{
+    int slots = 0;
+    int runs = 0;
+    int freeRuns = 0;
+    int largestFree = 0;
+    int freeRun = 0;
+
+    for (int slot = 0; slot < swapTableSize; slot++) {
+        if (swapTable[slot].pid == pid) {
+            slots++;
+            if (slot == 0 || swapTable[slot - 1].pid != pid) {
+                runs++;
+            }
+        }
+        if (swapTable[slot].pid == -1) {
+            if (freeRun++ == 0) {
+                freeRuns++;
+            }
+            largestFree = freeRun > largestFree ? freeRun : largestFree;
+        } else {
+            freeRun = 0;
+        }
+    }
+    if (slots == 0) {
+        return;
+    }
+    P3_swapStats.fragProcesses++;
+    P3_swapStats.fragSlots += slots;
+    P3_swapStats.fragRuns += runs;
+    if (freeRuns > P3_swapStats.freeRunsMax) {
+        P3_swapStats.freeRunsMax = freeRuns;
+    }
+    if (P3_swapStats.fragProcesses == 1 || largestFree < P3_swapStats.largestFreeMin) {
+        P3_swapStats.largestFreeMin = largestFree;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SlotWrite --
+ *
+ *  Starts writing a page to its slot and frees data, a P3_SLAB_PAGE
+ *  buffer, once it is no longer needed. Without compression the page is written to the
+ *  slot's block. With it, a page that compresses to at most half of a
+ *  pack's room is added to the open pack and gives up its block, and
+ *  any other page is written to a block of its own.
+ *
+ * Results:
+ *   The write to pass to P3SwapFinish, -1 if the page was packed.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+SlotWrite(int slot, void *data)
+{
+    SwapSpace *space = &swapTable[slot];
+
+    if (!P3_swapOptions.compress) {
+        return IOSubmit(1, getUnit(slot), getTrack(slot), getSector(slot), sectorInPage, data, slot,
+                        P3_SLAB_PAGE);
+    }
+
+    rc = P1_P(packSem);
+    assert(rc == P1_SUCCESS);
+
+    PackRemove(slot);
+
+    // the compressed page is at most half a page, so it fits in a page buffer
+    int limit = (pageSize - (int) sizeof(PackHeader)) / 2;
+    unsigned char *compressed = P3SlabAlloc(P3_SLAB_PAGE);
+    int length = Compress(data, compressed, limit);
+    if (length == -1) {
+        if (space->block == -1) {
+            space->block = BlockAlloc();
+        }
+        P3_swapStats.unpackedPages++;
+        rc = P1_V(packSem);
+        assert(rc == P1_SUCCESS);
+        P3SlabFree(P3_SLAB_PAGE, compressed);
+        return IOSubmit(1, getUnit(space->block), getTrack(space->block), getSector(space->block),
+                        sectorInPage, data, slot, P3_SLAB_PAGE);
+    }
+
+    if (openPack != -1 && (packs[openPack].used + length > pageSize ||
+            ((PackHeader *) packs[openPack].data)->count == PACK_PAGES)) {
+        PackFlush();
+    }
+    if (openPack == -1) {
+        for (int p = 0; p < blocksNum; p++) {
+            if (packs[p].used == 0) {
+                openPack = p;
+                break;
+            }
+        }
+        assert(openPack != -1);
+        packs[openPack].data = P3SlabAlloc(P3_SLAB_PAGE);
+        packs[openPack].used = sizeof(PackHeader);
+        packs[openPack].live = 0;
+        packs[openPack].block = -1;
+        ((PackHeader *) packs[openPack].data)->count = 0;
+    }
+
+    Pack *pack = &packs[openPack];
+    PackHeader *header = (PackHeader *) pack->data;
+    memcpy(pack->data + pack->used, compressed, length);
+    header->entries[header->count].slot = slot;
+    header->entries[header->count].offset = pack->used;
+    header->entries[header->count].length = length;
+    header->count++;
+    space->pack = openPack;
+    space->packOffset = pack->used;
+    space->packLength = length;
+    pack->used += length;
+    pack->live++;
+
+    if (space->block != -1) {
+        BlockFree(space->block);
+        space->block = -1;
+    }
+    P3_swapStats.packedPages++;
+
+    rc = P1_V(packSem);
+    assert(rc == P1_SUCCESS);
+
+    P3SlabFree(P3_SLAB_PAGE, compressed);
+    P3SlabFree(P3_SLAB_PAGE, data);
+    return -1;
+}
+
+/*
+ * Decompresses a packed page into addr, reading its pack's block unless the pack is still
+ * open.
+ */
+static void
+PackRead(int slot, void *addr)
+{
+    rc = P1_P(packSem);
+    assert(rc == P1_SUCCESS);
+
+    Pack *pack = &packs[swapTable[slot].pack];
+    char *data = pack->data;
+    if (data == NULL) {
+        data = P3SlabAlloc(P3_SLAB_PAGE);
+        rc = SwapDiskIO(0, getUnit(pack->block), getTrack(pack->block), getSector(pack->block),
+                        sectorInPage, data);
+        assert(rc == P1_SUCCESS);
+        P3_swapStats.packReads++;
+    }
+    Decompress((unsigned char *) data + swapTable[slot].packOffset, swapTable[slot].packLength, addr);
+    if (data != pack->data) {
+        P3SlabFree(P3_SLAB_PAGE, data);
+    }
+
+    rc = P1_V(packSem);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Takes a slot out of its pack, if it is in one, because the page is being written again or
+ * going away. A pack with no current pages left frees its block. Caller must hold packSem.
+ */
+static void
+PackRemove(int slot)
+{
+    int p = swapTable[slot].pack;
+
+    if (p == -1) {
+        return;
+    }
+    swapTable[slot].pack = -1;
+    if (--packs[p].live > 0) {
+        return;
+    }
+    if (p == openPack) {
+        // nothing in the open pack is current, start it over
+        packs[p].used = sizeof(PackHeader);
+        ((PackHeader *) packs[p].data)->count = 0;
+    } else {
+        BlockFree(packs[p].block);
+        packs[p].block = -1;
+        packs[p].used = 0;
+    }
+}
+
+/*
+ * Writes the open pack, directory and all, to a block of its own. Caller must hold packSem.
+ */
+static void
+PackFlush(void)
+{
+    Pack *pack = &packs[openPack];
+
+    pack->block = BlockAlloc();
+    rc = SwapDiskIO(1, getUnit(pack->block), getTrack(pack->block), getSector(pack->block),
+                    sectorInPage, pack->data);
+    assert(rc == P1_SUCCESS);
+    P3SlabFree(P3_SLAB_PAGE, pack->data);
+    pack->data = NULL;
+    openPack = -1;
+    P3_swapStats.packWrites++;
+
+    rc = P1_P(vmStats);
+    assert(rc == P1_SUCCESS);
+    P3_vmStats.pageOuts += 1;
+    rc = P1_V(vmStats);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Allocates a block for a pack or an uncompressed page. P3SwapIn keeps a block for every
+ * frame, so running out means swap is corrupt. Caller must hold packSem.
+ */
+static int
+BlockAlloc(void)
+{
+    for (int block = 0; block < blocksNum; block++) {
+        if (!blockUsed[block]) {
+            blockUsed[block] = 1;
+            rc = P1_P(vmStats);
+            assert(rc == P1_SUCCESS);
+            P3_vmStats.freeBlocks -= 1;
+            rc = P1_V(vmStats);
+            assert(rc == P1_SUCCESS);
+            return block;
+        }
+    }
+    USLOSS_Console("BlockAlloc: out of swap blocks\n");
+    USLOSS_Halt(1);
+    return -1;
+}
+
+/*
+ * Frees a block. Caller must hold packSem.
+ */
+static void
+BlockFree(int block)
+{
+    blockUsed[block] = 0;
+    rc = P1_P(vmStats);
+    assert(rc == P1_SUCCESS);
+    P3_vmStats.freeBlocks += 1;
+    rc = P1_V(vmStats);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Compresses a page with run-length encoding. A control byte c below 128 is followed by c + 1
+ * literal bytes, any other by one byte that is repeated c - 125 times.
+ *
+ * Returns the compressed length, -1 if it would be longer than limit.
+ */
+static int
+Compress(unsigned char *src, unsigned char *dst, int limit)
+{
+    int in = 0;
+    int out = 0;
+
+    while (in < pageSize) {
+        int run = 1;
+        while (in + run < pageSize && run < 130 && src[in + run] == src[in]) {
+            run++;
+        }
+        if (run >= 3) {
+            if (out + 2 > limit) {
+                return -1;
+            }
+            dst[out++] = run + 125;
+            dst[out++] = src[in];
+            in += run;
+            continue;
+        }
+
+        // literals up to the next run of three
+        int start = in;
+        int count = 0;
+        while (in < pageSize && count < 128) {
+            if (in + 2 < pageSize && src[in] == src[in + 1] && src[in] == src[in + 2]) {
+                break;
+            }
+            in++;
+            count++;
+        }
+        if (out + 1 + count > limit) {
+            return -1;
+        }
+        dst[out++] = count - 1;
+        memcpy(dst + out, src + start, count);
+        out += count;
+    }
+    return out;
+}
+
+/*
+ * Reverses Compress.
+ */
+static void
+Decompress(unsigned char *src, int length, unsigned char *dst)
+{
+    int in = 0;
+    int out = 0;
+
+    while (in < length) {
+        int c = src[in++];
+        if (c < 128) {
+            memcpy(dst + out, src + in, c + 1);
+            in += c + 1;
+            out += c + 1;
+        } else {
+            memset(dst + out, src[in++], c - 125);
+            out += c - 125;
+        }
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SwapDiskIO --
+ *
+ *  Reads or writes sectors on a swap disk unit and waits for the I/O
+ *  to complete.
+ *
+ * Results:
+ *   The result of the P2_DiskRead or P2_DiskWrite.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+SwapDiskIO(int write, int unit, int track, int first, int sectors, void *buffer)
+{
+    int io = IOSubmit(write, unit, track, first, sectors, buffer, -1, -1);
+    int result = IOWait(io);
+    IOFree(io);
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IOSubmit --
+ *
+ *  Starts a read or write of sectors on a swap disk unit. Blocks if
+ *  every request in the pool is outstanding. Without the schedulers the
+ *  I/O is done before IOSubmit returns, otherwise it is queued for the
+ *  unit's scheduler. Either way the request's done semaphore is V'd when the
+ *  I/O has completed. Slot is the swap slot the I/O is for, if any;
+ *  if slab isn't -1 the buffer came from it and IOFree frees it.
+ *
+ * Results:
+ *   The request, to be passed to IOWait and then IOFree.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+IOSubmit(int write, int unit, int track, int first, int sectors, void *buffer, int slot, int slab)
+{
+    rc = P1_P(ioFreeSem);
+    assert(rc == P1_SUCCESS);
+
+    rc = P1_P(ioQueueSem);
+    assert(rc == P1_SUCCESS);
+
+    int io = 0;
+    while (ioRequests[io].inUse) {
+        io++;
+    }
+    IORequest *req = &ioRequests[io];
+    req->inUse = 1;
+    req->write = write;
+    req->unit = unit;
+    req->track = track;
+    req->first = first;
+    req->sectors = sectors;
+    req->buffer = buffer;
+    req->slab = slab;
+    req->slot = slot;
+    req->frame = -1;
+    req->cluster = 0;
+    req->seq = ++ioSeq;
+    req->next = NULL;
+
+    P3_swapStats.unitIOs[unit]++;
+
+    if (!ioRunning) {
+        rc = P1_V(ioQueueSem);
+        assert(rc == P1_SUCCESS);
+        if (write) {
+            req->result = P2_DiskWrite(unit, track, first, sectors, buffer);
+        } else {
+            req->result = P2_DiskRead(unit, track, first, sectors, buffer);
+        }
+        rc = P1_V(req->done);
+        assert(rc == P1_SUCCESS);
+        return io;
+    }
+
+    rc = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &req->when);
+    assert(rc == USLOSS_DEV_OK);
+    IOUnit *u = &ioUnits[unit];
+
+    // a queued write of the same sectors is superseded and done without going to the disk,
+    // so the older page can't land after this one
+    if (write) {
+        IORequest *old = u->queue;
+        while (old != NULL) {
+            IORequest *following = old->next;
+            if (old->write && old->track == track && old->first == first && old->sectors == sectors) {
+                IOUnlink(u, old);
+                old->result = P1_SUCCESS;
+                rc = P1_V(old->done);
+                assert(rc == P1_SUCCESS);
+            }
+            old = following;
+        }
+    }
+
+    // the queue is kept in the order the requests were submitted, which the scheduler relies
+    // on to issue requests for the same sectors oldest first
+    IORequest **tail = &u->queue;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = req;
+    u->depth++;
+    P3_swapStats.ioRequests++;
+    P3_swapStats.ioDepthSum += u->depth;
+    if (u->depth > P3_swapStats.ioMaxDepth) {
+        P3_swapStats.ioMaxDepth = u->depth;
+    }
+    rc = P1_V(ioQueueSem);
+    assert(rc == P1_SUCCESS);
+
+    rc = P1_V(u->pendingSem);
+    assert(rc == P1_SUCCESS);
+    return io;
+}
+
+/*
+ * Waits for a request to complete and returns its result. The request stays in use until
+ * IOFree.
+ */
+static int
+IOWait(int io)
+{
+    rc = P1_P(ioRequests[io].done);
+    assert(rc == P1_SUCCESS);
+    return ioRequests[io].result;
+}
+
+/*
+ * Returns a completed request to the pool.
+ */
+static void
+IOFree(int io)
+{
+    rc = P1_P(ioQueueSem);
+    assert(rc == P1_SUCCESS);
+    if (ioRequests[io].slab != -1) {
+        P3SlabFree(ioRequests[io].slab, ioRequests[io].buffer);
+    }
+    ioRequests[io].buffer = NULL;
+    ioRequests[io].inUse = 0;
+    rc = P1_V(ioQueueSem);
+    assert(rc == P1_SUCCESS);
+
+    rc = P1_V(ioFreeSem);
+    assert(rc == P1_SUCCESS);
+}
+
+/*
+ * Copies the page an outstanding write is putting in the slot to addr, since the slot on the
+ * disk may still hold older contents. A page can be evicted, faulted back in, and evicted
+ * again before the first write completes, so the newest write is the one copied. Returns 1
+ * if there was such a write, 0 otherwise.
+ */
+static int
+IOForward(int slot, void *addr)
+{
+    IORequest *newest = NULL;
+
+    rc = P1_P(ioQueueSem);
+    assert(rc == P1_SUCCESS);
+    for (int io = 0; io < IO_REQUESTS; io++) {
+        IORequest *req = &ioRequests[io];
+        if (req->inUse && req->write && req->slot == slot && (newest == NULL || req->seq > newest->seq)) {
+            newest = req;
+        }
+    }
+    if (newest != NULL) {
+        memcpy(addr, newest->buffer, pageSize);
+    }
+    rc = P1_V(ioQueueSem);
+    assert(rc == P1_SUCCESS);
+    return newest != NULL;
+}
+
+/*
+ * Removes a request from a unit's queue. Caller must hold ioQueueSem.
+ */
+static void
+IOUnlink(IOUnit *u, IORequest *req)
+{
+    IORequest **prev = &u->queue;
+    while (*prev != req) {
+        prev = &(*prev)->next;
+    }
+    *prev = req->next;
+    u->depth--;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IOScheduler --
+ *
+ *  Issues the swap requests queued for one disk unit, which is passed
+ *  as the argument. Without the elevator they are issued
+ *  oldest first. With it the next request is the oldest one if it has
+ *  waited longer than ioDeadline, otherwise the one with the lowest
+ *  track at or past the head, wrapping around to the lowest track
+ *  (C-SCAN), and requests of the same kind for sectors adjacent to it
+ *  on the same track are merged into one disk operation. Ties go to
+ *  the request that was queued first.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+IOScheduler(void *arg)
+{
+    IORequest *batch[IO_REQUESTS];
+    int unit = (int) (long) arg;
+    IOUnit *u = &ioUnits[unit];
+
+    while (1) {
+        rc = P1_P(u->pendingSem);
+        assert(rc == P1_SUCCESS);
+
+        rc = P1_P(ioQueueSem);
+        assert(rc == P1_SUCCESS);
+
+        if (u->queue == NULL) {
+            rc = P1_V(ioQueueSem);
+            assert(rc == P1_SUCCESS);
+            if (!ioRunning) {
+                break;
+            }
+            continue;
+        }
+
+        int now;
+        rc = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &now);
+        assert(rc == USLOSS_DEV_OK);
+
+        IORequest *next = NULL;
+        IORequest *oldest = NULL;
+        IORequest *lowest = NULL;
+        for (IORequest *req = u->queue; req != NULL; req = req->next) {
+            if (oldest == NULL || req->when < oldest->when) {
+                oldest = req;
+            }
+            if (lowest == NULL || req->track < lowest->track) {
+                lowest = req;
+            }
+            if (req->track >= u->head && (next == NULL || req->track < next->track ||
+                    (req->track == next->track && req->first < next->first))) {
+                next = req;
+            }
+        }
+        if (!P3_swapOptions.elevator || now - oldest->when > P3_swapOptions.ioDeadline) {
+            next = oldest;
+        } else if (next == NULL) {
+            next = lowest;
+        }
+        IOUnlink(u, next);
+
+        // merge requests that extend the run of sectors on either side
+        int count = 1;
+        int first = next->first;
+        int last = next->first + next->sectors;
+        batch[0] = next;
+        for (int merged = P3_swapOptions.elevator; merged; ) {
+            merged = 0;
+            for (IORequest *req = u->queue; req != NULL; req = req->next) {
+                if (req->write != next->write || req->track != next->track) {
+                    continue;
+                }
+                if (req->first == last || req->first + req->sectors == first) {
+                    IOUnlink(u, req);
+                    batch[count++] = req;
+                    first = req->first < first ? req->first : first;
+                    last = req->first + req->sectors > last ? req->first + req->sectors : last;
+                    merged = 1;
+                    P3_swapStats.ioMerges++;
+                    break;
+                }
+            }
+        }
+
+        rc = P1_V(ioQueueSem);
+        assert(rc == P1_SUCCESS);
+
+        // each merged request was V'd on the unit's pendingSem, consume those
+        for (int n = 1; n < count; n++) {
+            rc = P1_P(u->pendingSem);
+            assert(rc == P1_SUCCESS);
+        }
+
+        P3_swapStats.ioSeekTracks += next->track > u->head ? next->track - u->head : u->head - next->track;
+        u->head = next->track;
+
+        int result;
+        if (count == 1) {
+            if (next->write) {
+                result = P2_DiskWrite(unit, next->track, next->first, next->sectors, next->buffer);
+            } else {
+                result = P2_DiskRead(unit, next->track, next->first, next->sectors, next->buffer);
+            }
+        } else {
+            // the merged requests are all on one track
+            char *buffer = u->merge;
+            if (next->write) {
+                for (int n = 0; n < count; n++) {
+                    memcpy(buffer + (batch[n]->first - first) * sectorByte, batch[n]->buffer,
+                        batch[n]->sectors * sectorByte);
+                }
+                result = P2_DiskWrite(unit, next->track, first, last - first, buffer);
+            } else {
+                result = P2_DiskRead(unit, next->track, first, last - first, buffer);
+                for (int n = 0; n < count; n++) {
+                    memcpy(batch[n]->buffer, buffer + (batch[n]->first - first) * sectorByte,
+                        batch[n]->sectors * sectorByte);
+                }
+            }
+        }
+
+        for (int n = 0; n < count; n++) {
+            batch[n]->result = result;
+            rc = P1_V(batch[n]->done);
+            assert(rc == P1_SUCCESS);
+        }
+    }
+
+    rc = P1_V(ioDoneSem);
+    assert(rc == P1_SUCCESS);
+    return 0;
+}
+
+/*
+ * Records that the frame holds the process's page, whose copy on swap is in the slot.
+ * The frame stays busy until the frame layer maps the page to it. Caller must hold
+ * P3_frames.sem.
+ */
+static void
+FrameAssign(int frame, PID pid, int page, int slot)
+{
+    P3FrameOwnerSet(frame, pid, page);
+    P3_frames.slot[frame] = slot;
+
+    residentSets[pid].resident++;
+
+    // the page is about to be touched, don't let it look like the oldest frame
+    P3_frames.age[frame] = AGE_REFERENCED;
+}
+
+/*
+ * Returns true if the frame belongs to a process that owns more frames than its target.
+ */
+static int
+OverTarget(int frame)
+{
+    int pid = P3_frames.pid[frame];
+    return (pid != -1) && (residentSets[pid].resident > residentSets[pid].target);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResidentSetFault --
+ *
+ *  Adjusts a process's resident set target using the time since its
+ *  previous fault. Faults that come quickly mean the process needs more
+ *  frames, faults that are far apart mean it can give some up. The
+ *  target stays between one frame and the number of frames.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+ResidentSetFault(PID pid)
+{
+    ResidentSet *set = &residentSets[pid];
+    int now;
+
+    rc = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &now);
+    assert(rc == USLOSS_DEV_OK);
+
+    if (set->lastFault != 0) {
+        int interval = now - set->lastFault;
+        if (interval < P3_swapOptions.pffGrow && set->target < framesNum) {
+            set->target++;
+            P3_swapStats.targetGrows++;
+        } else if (interval > P3_swapOptions.pffShrink && set->target > 1) {
+            set->target--;
+            P3_swapStats.targetShrinks++;
+        }
+    }
+    set->lastFault = now;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ager --
+ *
+ *  Aging daemon. Every agingInterval seconds it shifts each frame's
+ *  reference bit into the frame's age counter and clears the bit.
+ *  Quits when P3SwapShutdown clears agerRunning.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+Ager(void *arg)
+{
+    int access;
+
+    while (1) {
+        rc = P2_Sleep(P3_swapOptions.agingInterval);
+        assert(rc == P1_SUCCESS);
+
+        if (!agerRunning) {
+            break;
+        }
+
+        rc = P1_P(clockHand);
+        assert(rc == P1_SUCCESS);
+
+        for (int f = 0; f < framesNum; f++) {
+            if (P3_frames.pid[f] == -1 || (P3_frames.flags[f] & P3_FRAME_BUSY)) {
+                continue;
+            }
+            rc = USLOSS_MmuGetAccess(f, &access);
+            assert(rc == USLOSS_MMU_OK);
+
+            P3_frames.age[f] >>= 1;
+            if (access & USLOSS_MMU_REF) {
+                P3_frames.age[f] |= AGE_REFERENCED;
+                rc = USLOSS_MmuSetAccess(f, access & ~USLOSS_MMU_REF);
+                assert(rc == USLOSS_MMU_OK);
+            }
+        }
+        P3_swapStats.agingSamples++;
+
+        rc = P1_V(clockHand);
+        assert(rc == P1_SUCCESS);
+    }
+    rc = P1_V(agerDone);
+    assert(rc == P1_SUCCESS);
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3SwapInBatch --
+ *
+ *  Reads several of a process's pages into frames, pages[n] into
+ *  frames[n]. The reads are sorted by swap slot and runs of adjacent
+ *  slots on the same track, up to P3_swapOptions.cluster of them, are
+ *  read with one P2_DiskRead. Pages that have no copy on the swap disk
+ *  are skipped and their frames[n] is set to -1 so the caller can give
+ *  them back.
+ *
+ * Results:
+ *   P3_NOT_INITIALIZED:    P3SwapInit has not been called
+ *   P1_INVALID_PID:        pid is invalid
+ *   P1_SUCCESS:            success
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3SwapInBatch(PID pid, int *pages, int *frames, int count)
+{
+    if (!initialized)
+        return P3_NOT_INITIALIZED;
+
+    if (pid < 0 || pid >= P1_MAXPROC)
+        return P1_INVALID_PID;
+
+    assert(count <= framesNum);
+    int run = P3_swapOptions.cluster > 1 && !P3_swapOptions.compress ? P3_swapOptions.cluster : 1;
+    int slab = run > 1 ? P3_SLAB_CLUSTER : P3_SLAB_PAGE;
+    char *buffer = P3SlabAlloc(slab);
+
+    rc = P1_P(swapTableSem);
+    assert(rc == P1_SUCCESS);
+
+    // there is never more than a page per frame, batchSlots and batchOrder hold that many
+    int *slots = batchSlots;
+    int *order = batchOrder;
+
+    // find each page's slot and sort the pages by slot
+    int n = 0;
+    for (int p = 0; p < count; p++) {
+        slots[p] = -1;
+        for (int slot = 0; slot < swapTableSize; slot++) {
+            if (swapTable[slot].pid == pid && swapTable[slot].page == pages[p]) {
+                if (swapTable[slot].allocated == 1) {
+                    slots[p] = slot;
+                }
+                break;
+            }
+        }
+        if (slots[p] == -1) {
+            frames[p] = -1;
+            continue;
+        }
+        int k = n++;
+        while (k > 0 && slots[order[k - 1]] > slots[p]) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = p;
+    }
+
+    for (int first = 0; first < n; ) {
+        int len = 1;
+        int slot = slots[order[first]];
+        while (first + len < n && len < run && slots[order[first + len]] == slot + len &&
+                Contiguous(slot, len)) {
+            len++;
+        }
+
+        // a compressed page is read from its pack, one that was never written out has only
+        // the copy in the fast tier or an outstanding write
+        int block = swapTable[slot].block;
+        if (swapTable[slot].pack != -1) {
+            PackRead(slot, buffer);
+        } else if (block != -1) {
+            rc = SwapDiskIO(0, getUnit(block), getTrack(block), getSector(block), len * sectorInPage, buffer);
+            assert(rc == P1_SUCCESS);
+        }
+        P3_swapStats.prepageReads++;
+
+        for (int k = 0; k < len; k++) {
+            int p = order[first + k];
+            void *addr;
+
+            CacheDrop(slots[p]);
+            rc = P3FrameMap(frames[p], &addr);
+            assert(rc == P1_SUCCESS);
+            memcpy(addr, buffer + k * pageSize, pageSize);
+            if (!FastGet(slots[p], addr)) {
+                IOForward(slots[p], addr);
+            }
+            rc = P3FrameUnmap(frames[p]);
+            assert(rc == P1_SUCCESS);
+
+            rc = P1_P(P3_frames.sem);
+            assert(rc == P1_SUCCESS);
+            FrameAssign(frames[p], pid, pages[p], slots[p]);
+            rc = P1_V(P3_frames.sem);
+            assert(rc == P1_SUCCESS);
+        }
+
+        rc = P1_P(vmStats);
+        assert(rc == P1_SUCCESS);
+        P3_vmStats.pageIns += len;
+        rc = P1_V(vmStats);
+        assert(rc == P1_SUCCESS);
+
+        P3_swapStats.prepagePages += len;
+        first += len;
+    }
+
+    rc = P1_V(swapTableSem);
+    assert(rc == P1_SUCCESS);
+
+    P3SlabFree(slab, buffer);
+    return P1_SUCCESS;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * P3SwapCached --
+ *
+ *  Checks whether a page has a copy on the swap disk, i.e. whether
+ *  P3SwapIn would read it rather than return P3_EMPTY_PAGE. Unlike
+ *  P3SwapIn it never allocates swap space.
+ *
+ * Results:
+ *   TRUE if the page is on the swap disk, FALSE otherwise.
+ *
+ *----------------------------------------------------------------------
+ */
+int
+P3SwapCached(PID pid, int page)
+{
+    int cached = FALSE;
+
+    if (!initialized)
+        return FALSE;
+
+    rc = P1_P(swapTableSem);
+    assert(rc == P1_SUCCESS);
+
+    for (int slot = 0; slot < swapTableSize; slot++) {
+        if (swapTable[slot].pid == pid && swapTable[slot].page == page) {
+            cached = swapTable[slot].allocated == 1;
+            break;
+        }
+    }
+
+    rc = P1_V(swapTableSem);
+    assert(rc == P1_SUCCESS);
+
+    return cached;
+}
+
 void printFrameTable() {
 
     USLOSS_Console("Frame {\n");
     for (i = 0; i < framesNum; i++) {
 
-        int pid  = frameTable[i].pid;
-        int page = frameTable[i].page;
-        int busy = frameTable[i].busy;
+        int pid  = P3_frames.pid[i];
+        int page = P3_frames.page[i];
+        int busy = (P3_frames.flags[i] & P3_FRAME_BUSY);
         int acc =1 ; 
         //rc = USLOSS_MmuGetAccess(hand,&acc);
         //assert(rc == USLOSS_MMU_OK);
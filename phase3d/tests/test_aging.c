@@ -0,0 +1,232 @@
+/*
+ * test_aging.c
+ *
+ *  Runs a looping workload and a Zipfian workload with the aging replacement policy and
+ *  prints the number of faults each one took. Run it as "test_aging clock" to use the
+ *  clock algorithm instead so the two policies can be compared.
+ *
+ *  With aging the Zipfian child must take fewer faults than the clock algorithm takes on
+ *  the same sequence of pages. The clock's count comes from replaying the sequence against
+ *  a simulated clock with FRAMES frames, since the VM system can only be started once.
+ *
+ *  The looping child walks through all of its pages in order, which is more pages than
+ *  there are frames. The Zipfian child touches page k with probability proportional to
+ *  1/(k+1) so a few pages are hot and the rest are cold. Both children write a signature
+ *  into every page they touch and verify it on the next touch.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 8         // # of pages per process
+#define FRAMES 4        // # of frames
+#define ITERATIONS 4    // # of passes over the pages by the looping child
+#define TOUCHES 64      // # of page touches by the Zipfian child
+#define PAGERS 2        // # of pagers
+
+static char *vmRegion;
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+/*
+ * Writes the signature into the page the first time it is touched and checks it afterwards.
+ */
+static void
+Touch(int j, char *written)
+{
+    char *page = vmRegion + j * pageSize;
+    if (written[j]) {
+        TEST(page[0], 'A' + j);
+        TEST(page[pageSize - 1], 'A' + j);
+    } else {
+        TEST(page[0], '\0');
+        page[0] = 'A' + j;
+        page[pageSize - 1] = 'A' + j;
+        written[j] = 1;
+    }
+}
+
+static int
+Loop(void *arg)
+{
+    char    written[PAGES] = {0};
+    int     rc;
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int j = 0; j < PAGES; j++) {
+            Debug("Loop touching page %d\n", j);
+            Touch(j, written);
+        }
+        rc = Sys_Sleep(1);
+        assert(rc == P1_SUCCESS);
+    }
+    return 0;
+}
+
+/*
+ * Returns the next page of the Zipfian sequence, page k with probability proportional to 1/(k+1).
+ */
+static int
+ZipfNext(unsigned int *seed)
+{
+    int     total = 0;
+    int     cdf[PAGES];
+    int     x;
+    int     j;
+
+    for (j = 0; j < PAGES; j++) {
+        total += 840 / (j + 1);
+        cdf[j] = total;
+    }
+    *seed = *seed * 1103515245 + 12345;
+    x = (*seed >> 16) % total;
+    for (j = 0; cdf[j] <= x; j++) {
+    }
+    return j;
+}
+
+/*
+ * Returns the # of faults the clock algorithm takes on the Zipfian sequence.
+ */
+static int
+ClockFaults(void)
+{
+    int             pages[FRAMES];
+    int             referenced[FRAMES] = {0};
+    int             hand = 0;
+    int             faults = 0;
+    unsigned int    seed = 12345;
+
+    for (int f = 0; f < FRAMES; f++) {
+        pages[f] = -1;
+    }
+    for (int i = 0; i < TOUCHES; i++) {
+        int j = ZipfNext(&seed);
+        int f;
+        for (f = 0; (f < FRAMES) && (pages[f] != j); f++) {
+        }
+        if (f == FRAMES) {
+            faults++;
+            for (f = 0; (f < FRAMES) && (pages[f] != -1); f++) {
+            }
+            if (f == FRAMES) {
+                while (referenced[hand]) {
+                    referenced[hand] = 0;
+                    hand = (hand + 1) % FRAMES;
+                }
+                f = hand;
+                hand = (hand + 1) % FRAMES;
+            }
+            pages[f] = j;
+        }
+        referenced[f] = 1;
+    }
+    return faults;
+}
+
+static int
+Zipf(void *arg)
+{
+    char            written[PAGES] = {0};
+    unsigned int    seed = 12345;
+    int             rc;
+
+    for (int i = 0; i < TOUCHES; i++) {
+        int j = ZipfNext(&seed);
+        Debug("Zipf touching page %d\n", j);
+        Touch(j, written);
+        if ((i % 8) == 7) {
+            rc = Sys_Sleep(1);
+            assert(rc == P1_SUCCESS);
+        }
+    }
+    return 0;
+}
+
+static int
+Run(char *name, int (*func)(void *))
+{
+    int     rc;
+    int     pid;
+    int     status;
+    int     faults = P3_vmStats.faults;
+
+    rc = Sys_Spawn(name, func, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+    faults = P3_vmStats.faults - faults;
+    USLOSS_Console("%s: %s faults: %d\n", name,
+        P3_swapOptions.replacement == P3_REPLACE_AGING ? "aging" : "clock", faults);
+    return faults;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     faults;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    Run("Loop", Loop);
+    faults = Run("Zipf", Zipf);
+    if (P3_swapOptions.replacement == P3_REPLACE_AGING) {
+        USLOSS_Console("Zipf: simulated clock faults: %d\n", ClockFaults());
+        TEST(faults < ClockFaults(), 1);
+    }
+    Sys_VmShutdown();
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_swapOptions.replacement = P3_REPLACE_AGING;
+    if ((argc > 1) && (strcmp(argv[1], "clock") == 0)) {
+        P3_swapOptions.replacement = P3_REPLACE_CLOCK;
+    }
+    P3_swapOptions.agingInterval = 1;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, 2 * PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
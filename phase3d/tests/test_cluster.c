@@ -0,0 +1,111 @@
+/*
+ * test_cluster.c
+ *
+ *  Tests clustered swap reads. A single child writes a signature into each of its pages in
+ *  order, then reads them back in the same order. There are far fewer frames than pages so
+ *  the first pass evicts the pages into consecutive swap slots, and on the second pass a
+ *  fault on one page should read the slots after it too and the faults on those pages
+ *  should be satisfied from the cluster cache.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 8         // # of pages per process
+#define FRAMES 2        // # of frames
+#define CLUSTER 4       // most slots read at once
+#define PAGERS 2        // # of pagers
+
+static char *vmRegion;
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+Child(void *arg)
+{
+    char    *page;
+
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child writing page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = 'A' + j;
+        }
+    }
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child reading page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], 'A' + j);
+        }
+    }
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+    Sys_VmShutdown();
+
+    TEST(P3_swapStats.clusterReads > 0, 1);
+    TEST(P3_swapStats.clusterHits > 0, 1);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_swapOptions.cluster = CLUSTER;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
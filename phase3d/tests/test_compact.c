@@ -0,0 +1,147 @@
+/*
+ * test_compact.c
+ *
+ *  Tests swap compaction. Child "A" writes all of its pages, then child "B" writes all of
+ *  its pages, which pushes A's pages into the first swap slots and B's pages into the
+ *  slots after them. A then quits, leaving a hole at the start of swap in front of B's
+ *  slots. B sleeps long enough for the compactor to run a few times and then checks that
+ *  its pages still hold what it wrote, and the test checks that slots were moved.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 4         // # of pages per process
+#define FRAMES 2        // # of frames
+#define PAGERS 2        // # of pagers
+#define SLEEP 3         // seconds B sleeps while the compactor runs
+
+static char *vmRegion;
+static int  pageSize;
+static SID  aWritten;
+static SID  bWritten;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static void
+Write(char c)
+{
+    for (int j = 0; j < PAGES; j++) {
+        char *page = vmRegion + j * pageSize;
+        Debug("Child \"%c\" writing page %d\n", c, j);
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = c + j;
+        }
+    }
+}
+
+static int
+A(void *arg)
+{
+    int     rc;
+
+    Write('A');
+    rc = Sys_SemV(aWritten);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_SemP(bWritten);
+    assert(rc == P1_SUCCESS);
+    return 0;
+}
+
+static int
+B(void *arg)
+{
+    int     rc;
+
+    rc = Sys_SemP(aWritten);
+    assert(rc == P1_SUCCESS);
+    Write('B');
+    rc = Sys_SemV(bWritten);
+    assert(rc == P1_SUCCESS);
+
+    rc = Sys_Sleep(SLEEP);
+    assert(rc == P1_SUCCESS);
+    for (int j = 0; j < PAGES; j++) {
+        char *page = vmRegion + j * pageSize;
+        Debug("Child \"B\" reading page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], 'B' + j);
+        }
+    }
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    rc = Sys_SemCreate("aWritten", 0, &aWritten);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_SemCreate("bWritten", 0, &bWritten);
+    assert(rc == P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("A", A, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Spawn("B", B, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    for (int i = 0; i < 2; i++) {
+        rc = Sys_Wait(&pid, &status);
+        assert(rc == P1_SUCCESS);
+        TEST(status, 0);
+    }
+    Sys_VmShutdown();
+
+    TEST(P3_swapStats.compactMoves > 0, 1);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_swapOptions.compactInterval = 1;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, 2 * PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
@@ -0,0 +1,139 @@
+/*
+ * test_compress.c
+ *
+ *  Tests compressed swap. A single child fills its even pages with data that compresses
+ *  and its odd pages with data that doesn't, then reads them all back. There are fewer
+ *  frames than pages, so every page is written to swap and read back at least once. The
+ *  compressible pages hit the edges of the encoding: a run of the longest length one code
+ *  holds, a run one longer, a literal stretch longer than one code holds, and a page that
+ *  ends in fewer than three bytes that don't repeat.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 6         // # of pages per process
+#define FRAMES 2        // # of frames
+#define PAGERS 2        // # of pagers
+
+#define RUN 130         // longest run one code holds
+#define LITERALS 128    // most literals one code holds
+
+static char *vmRegion;
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+/*
+ * Returns the byte at offset k of page j.
+ */
+static char
+Byte(int j, int k)
+{
+    if (j % 2 == 1) {
+        // pseudo-random, no runs to speak of
+        return (char) (((unsigned) (k + 1) * 1103515245u + (unsigned) j * 12345u) >> 16);
+    }
+    if (k < RUN) {
+        return 'A' + j;
+    }
+    if (k < 2 * RUN + 1) {
+        return 'a' + j;
+    }
+    if (k < 2 * RUN + 1 + LITERALS) {
+        return (char) (k - 2 * RUN);
+    }
+    if (k < pageSize - 2) {
+        return '\0';
+    }
+    return k == pageSize - 2 ? 'y' : 'z';
+}
+
+static int
+Child(void *arg)
+{
+    char    *page;
+
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child writing page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = Byte(j, k);
+        }
+    }
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child reading page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], Byte(j, k));
+        }
+    }
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+    Sys_VmShutdown();
+
+    TEST(P3_swapStats.packedPages > 0, 1);
+    TEST(P3_swapStats.unpackedPages > 0, 1);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_swapOptions.compress = 1;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, PAGES + FRAMES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
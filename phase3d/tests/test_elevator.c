@@ -0,0 +1,153 @@
+/*
+ * test_elevator.c
+ *
+ *  Tests the swap I/O scheduler. Child "A" writes all of its pages, then child "B" writes
+ *  all of its pages, which pushes the rest of A's pages out to swap, and quits. A then
+ *  reads its pages back in order. The frames B freed are free, so readahead starts
+ *  several reads of A's consecutive slots at once, and the scheduler should merge the
+ *  ones that are next to each other on a track into one disk read. A checks its pages.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 16        // # of pages per process
+#define FRAMES 8        // # of frames
+#define B_PAGES FRAMES  // # of pages B writes
+#define PAGERS 2        // # of pagers
+
+static char *vmRegion;
+static int  pageSize;
+static SID  aWritten;
+static SID  bQuit;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+A(void *arg)
+{
+    char    *page;
+    int     rc;
+
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child \"A\" writing page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = 'A' + j;
+        }
+    }
+    rc = Sys_SemV(aWritten);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_SemP(bQuit);
+    assert(rc == P1_SUCCESS);
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child \"A\" reading page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], 'A' + j);
+        }
+    }
+    return 0;
+}
+
+static int
+B(void *arg)
+{
+    int     rc;
+
+    rc = Sys_SemP(aWritten);
+    assert(rc == P1_SUCCESS);
+    for (int j = 0; j < B_PAGES; j++) {
+        char *page = vmRegion + j * pageSize;
+        Debug("Child \"B\" writing page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = 'B';
+        }
+    }
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    rc = Sys_SemCreate("aWritten", 0, &aWritten);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_SemCreate("bQuit", 0, &bQuit);
+    assert(rc == P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("A", A, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Spawn("B", B, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+
+    // A is waiting, so B quits first and its frames are free before A reads
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+    rc = Sys_SemV(bQuit);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+    Sys_VmShutdown();
+
+    TEST(P3_pagerStats.readaheads > 0, 1);
+    TEST(P3_swapStats.ioMerges > 0, 1);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_swapOptions.elevator = 1;
+    P3_swapOptions.async = 1;
+    P3_pagerOptions.asyncSwap = 1;
+    P3_pagerOptions.readahead = 1;
+    P3_pagerOptions.readaheadMax = 4;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, PAGES + B_PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
@@ -0,0 +1,121 @@
+/*
+ * test_extents.c
+ *
+ *  Tests track-aligned swap extents. Children "A" and "B" write their pages at the same
+ *  time and read them back, twice over, so their first swap-ins are interleaved. With
+ *  extents each process's pages should still be placed in runs of slots reserved for it,
+ *  at their offsets within the run. The disk has room for every run, so no page should
+ *  have to go in the first free slot instead. Both children check their pages.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 8         // # of pages per process
+#define FRAMES 4        // # of frames
+#define ITERATIONS 2
+#define PAGERS 2        // # of pagers
+
+static char *vmRegion;
+static char *names[] = {"A","B"};
+static int  numChildren = sizeof(names) / sizeof(char *);
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+Child(void *arg)
+{
+    char    *name = (char *) arg;
+    char    *page;
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int j = 0; j < PAGES; j++) {
+            page = vmRegion + j * pageSize;
+            Debug("Child \"%s\" writing page %d\n", name, j);
+            for (int k = 0; k < pageSize; k++) {
+                page[k] = *name + i;
+            }
+        }
+        for (int j = 0; j < PAGES; j++) {
+            page = vmRegion + j * pageSize;
+            Debug("Child \"%s\" reading page %d\n", name, j);
+            for (int k = 0; k < pageSize; k++) {
+                TEST(page[k], *name + i);
+            }
+        }
+    }
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    for (int i = 0; i < numChildren; i++) {
+        rc = Sys_Spawn(names[i], Child, (void *) names[i], USLOSS_MIN_STACK * 4, 3, &pid);
+        assert(rc == P1_SUCCESS);
+    }
+    for (int i = 0; i < numChildren; i++) {
+        rc = Sys_Wait(&pid, &status);
+        assert(rc == P1_SUCCESS);
+        TEST(status, 0);
+    }
+    Sys_VmShutdown();
+
+    TEST(P3_swapStats.extentsReserved > 0, 1);
+    TEST(P3_swapStats.extentPlaced > 0, 1);
+    TEST(P3_swapStats.extentMisses, 0);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_swapOptions.extents = 1;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, 2 * numChildren * PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
@@ -0,0 +1,147 @@
+/*
+ * test_frames.c
+ *
+ *  Tests the frame descriptors. Child "A" writes more pages than there are frames, so every
+ *  frame ends up holding one of its pages, then waits. While A waits the parent checks
+ *  that every frame belongs to A, holds a distinct page in range and isn't busy. A then
+ *  reads its pages back and quits, after which every frame must be free again.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 6         // # of pages per process
+#define FRAMES 4        // # of frames
+#define PAGERS 2        // # of pagers
+
+static char *vmRegion;
+static int  pageSize;
+static SID  aWritten;
+static SID  checked;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+A(void *arg)
+{
+    char    *page;
+    int     rc;
+
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child \"A\" writing page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = 'A' + j;
+        }
+    }
+    rc = Sys_SemV(aWritten);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_SemP(checked);
+    assert(rc == P1_SUCCESS);
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child \"A\" reading page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], 'A' + j);
+        }
+    }
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     child;
+    int     status;
+    int     seen[PAGES];
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    rc = Sys_SemCreate("aWritten", 0, &aWritten);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_SemCreate("checked", 0, &checked);
+    assert(rc == P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("A", A, NULL, USLOSS_MIN_STACK * 4, 3, &child);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_SemP(aWritten);
+    assert(rc == P1_SUCCESS);
+
+    // A is waiting, so its frames don't change
+    TEST(P3_vmStats.freeFrames, 0);
+    for (int j = 0; j < PAGES; j++) {
+        seen[j] = 0;
+    }
+    for (int f = 0; f < FRAMES; f++) {
+        Debug("Frame %d: pid %d page %d\n", f, P3_frames.pid[f], P3_frames.page[f]);
+        TEST(P3_frames.pid[f], child);
+        TEST(P3_frames.page[f] >= 0 && P3_frames.page[f] < PAGES, 1);
+        TEST(seen[P3_frames.page[f]], 0);
+        seen[P3_frames.page[f]] = 1;
+        TEST(P3_frames.flags[f] & P3_FRAME_BUSY, 0);
+    }
+
+    rc = Sys_SemV(checked);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+
+    // A's frames went back to the pool
+    TEST(P3_vmStats.freeFrames, FRAMES);
+    for (int f = 0; f < FRAMES; f++) {
+        TEST(P3_frames.pid[f], -1);
+        TEST(P3_frames.page[f], -1);
+        TEST(P3_frames.slot[f], -1);
+        TEST(P3_frames.flags[f], 0);
+    }
+    Sys_VmShutdown();
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
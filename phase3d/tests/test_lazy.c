@@ -0,0 +1,152 @@
+/*
+ * test_lazy.c
+ *
+ *  Tests that page tables are created lazily. Child "A" writes all of its pages, which fit
+ *  in memory, then sleeps several times so that it is dispatched again and again, and
+ *  reads its pages back. Being dispatched must not fault or reload its page table. While
+ *  A sleeps the parent spawns idle children that never touch the VM region; they must not
+ *  take any frames. Only A's first touch of each page may fault.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 4         // # of pages per process
+#define FRAMES PAGES    // # of frames
+#define PAGERS 2        // # of pagers
+#define SLEEPS 3        // # of times A sleeps
+#define IDLERS 4        // # of children that don't use the VM region
+
+static char *vmRegion;
+static int  pageSize;
+static SID  aWritten;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+A(void *arg)
+{
+    char    *page;
+    int     faults;
+    int     reloads;
+    int     rc;
+
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child \"A\" writing page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = 'A' + j;
+        }
+    }
+    faults = P3_vmStats.faults;
+    reloads = P3_pagerStats.tableReloads;
+    rc = Sys_SemV(aWritten);
+    assert(rc == P1_SUCCESS);
+    for (int i = 0; i < SLEEPS; i++) {
+        rc = Sys_Sleep(1);
+        assert(rc == P1_SUCCESS);
+    }
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child \"A\" reading page %d\n", j);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], 'A' + j);
+        }
+    }
+    TEST(P3_vmStats.faults, faults);
+    TEST(P3_pagerStats.tableReloads, reloads);
+    return 0;
+}
+
+static int
+Idle(void *arg)
+{
+    int     rc;
+
+    rc = Sys_Sleep(1);
+    assert(rc == P1_SUCCESS);
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+    int     freeFrames;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    rc = Sys_SemCreate("aWritten", 0, &aWritten);
+    assert(rc == P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("A", A, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_SemP(aWritten);
+    assert(rc == P1_SUCCESS);
+
+    // A holds its frames while it sleeps, the idlers shouldn't take any more
+    freeFrames = P3_vmStats.freeFrames;
+    for (int i = 0; i < IDLERS; i++) {
+        rc = Sys_Spawn("Idle", Idle, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+        assert(rc == P1_SUCCESS);
+    }
+    for (int i = 0; i < IDLERS + 1; i++) {
+        rc = Sys_Wait(&pid, &status);
+        assert(rc == P1_SUCCESS);
+        TEST(status, 0);
+        if (i < IDLERS) {
+            TEST(P3_vmStats.freeFrames, freeFrames);
+        }
+    }
+    Sys_VmShutdown();
+
+    TEST(P3_vmStats.faults, PAGES);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
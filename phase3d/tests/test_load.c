@@ -0,0 +1,133 @@
+/*
+ * test_load.c
+ *
+ *  Tests load control. Children "A" and "B" each write their name into all of their pages
+ *  and then read them back over and over for a few seconds. Together they have twice as
+ *  many pages as there are frames, so they fault constantly and load control should
+ *  suspend one of them. Once the other is done the faults stop and the suspended child
+ *  should be resumed, with the pages it had in frames prepaged from the swap disk, and
+ *  finish. Both children check their pages on every pass.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 4         // # of pages per process
+#define FRAMES PAGES    // # of frames
+#define PAGERS 2        // # of pagers
+#define SECONDS 4       // how long each child keeps reading
+
+static char *vmRegion;
+static char *names[] = {"A","B"};
+static int  numChildren = sizeof(names) / sizeof(char *);
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+Child(void *arg)
+{
+    char    *name = (char *) arg;
+    char    *page;
+    int     start;
+    int     now;
+    int     rc;
+
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child \"%s\" writing page %d\n", name, j);
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = *name + j;
+        }
+    }
+    rc = Sys_GetTimeOfDay(&start);
+    assert(rc == P1_SUCCESS);
+    do {
+        for (int j = 0; j < PAGES; j++) {
+            page = vmRegion + j * pageSize;
+            Debug("Child \"%s\" reading page %d\n", name, j);
+            for (int k = 0; k < pageSize; k++) {
+                TEST(page[k], *name + j);
+            }
+        }
+        rc = Sys_GetTimeOfDay(&now);
+        assert(rc == P1_SUCCESS);
+    } while (now - start < SECONDS * 1000000);
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    for (int i = 0; i < numChildren; i++) {
+        rc = Sys_Spawn(names[i], Child, (void *) names[i], USLOSS_MIN_STACK * 4, 3, &pid);
+        assert(rc == P1_SUCCESS);
+    }
+    for (int i = 0; i < numChildren; i++) {
+        rc = Sys_Wait(&pid, &status);
+        assert(rc == P1_SUCCESS);
+        TEST(status, 0);
+    }
+    Sys_VmShutdown();
+
+    TEST(P3_pagerStats.suspends > 0, 1);
+    TEST(P3_pagerStats.resumes, P3_pagerStats.suspends);
+    TEST(P3_pagerStats.prepaged > 0, 1);
+    TEST(P3_swapStats.prepagePages > 0, 1);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_pagerOptions.loadControl = 1;
+    P3_pagerOptions.loadInterval = 1;
+    P3_pagerOptions.thrashFaults = 2;
+    P3_pagerOptions.thrashBusy = 0;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, numChildren * PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
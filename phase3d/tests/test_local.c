@@ -0,0 +1,138 @@
+/*
+ * test_local.c
+ *
+ *  Tests local replacement. Child "A" writes one page and then sleeps holding it, while
+ *  child "B" writes all of its pages and reads them back, several times over. Every
+ *  process's resident set target is one frame and never grows, so B is over its target
+ *  as soon as it has two frames and its own frames should be its victims, not A's page.
+ *  Both children check their pages at the end.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 6         // # of pages per process
+#define FRAMES 3        // # of frames
+#define ITERATIONS 3
+#define PAGERS 2        // # of pagers
+#define SLEEP 2         // seconds A holds its page
+
+static char *vmRegion;
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+A(void *arg)
+{
+    int     rc;
+
+    Debug("Child \"A\" writing page 0\n");
+    for (int k = 0; k < pageSize; k++) {
+        vmRegion[k] = 'A';
+    }
+    rc = Sys_Sleep(SLEEP);
+    assert(rc == P1_SUCCESS);
+    Debug("Child \"A\" reading page 0\n");
+    for (int k = 0; k < pageSize; k++) {
+        TEST(vmRegion[k], 'A');
+    }
+    return 0;
+}
+
+static int
+B(void *arg)
+{
+    char    *page;
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int j = 0; j < PAGES; j++) {
+            page = vmRegion + j * pageSize;
+            Debug("Child \"B\" writing page %d\n", j);
+            for (int k = 0; k < pageSize; k++) {
+                page[k] = 'B' + i + j;
+            }
+        }
+        for (int j = 0; j < PAGES; j++) {
+            page = vmRegion + j * pageSize;
+            Debug("Child \"B\" reading page %d\n", j);
+            for (int k = 0; k < pageSize; k++) {
+                TEST(page[k], 'B' + i + j);
+            }
+        }
+    }
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("A", A, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Spawn("B", B, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    for (int i = 0; i < 2; i++) {
+        rc = Sys_Wait(&pid, &status);
+        assert(rc == P1_SUCCESS);
+        TEST(status, 0);
+    }
+    Sys_VmShutdown();
+
+    TEST(P3_swapStats.localVictims > 0, 1);
+    TEST(P3_swapStats.targetGrows, 0);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_swapOptions.local = 1;
+    P3_swapOptions.initialTarget = 1;
+    P3_swapOptions.pffGrow = 0;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, 2 * PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ * test_reaper.c
+ *
+ *  Tests the reaper. Several waves of children are spawned, and each child writes a
+ *  signature into all of its pages, checks them, and quits. There are fewer frames than
+ *  pages in a wave, so a wave's faults need the frames of the wave before it while those
+ *  may still be waiting for the reaper. Once every child has quit and the reaper has had
+ *  a second to run, all the frames and swap blocks must be free again.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 4         // # of pages per process
+#define FRAMES 4        // # of frames
+#define CHILDREN 3      // # of children in a wave
+#define WAVES 4         // # of waves
+#define PAGERS 2        // # of pagers
+
+static char *vmRegion;
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+Child(void *arg)
+{
+    int     c = (int) arg;
+    char    *page;
+
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child %d writing page %d\n", c, j);
+        TEST(page[0], '\0');
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = c + j;
+        }
+    }
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child %d reading page %d\n", c, j);
+        for (int k = 0; k < pageSize; k++) {
+            TEST(page[k], (char) (c + j));
+        }
+    }
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    for (int w = 0; w < WAVES; w++) {
+        for (int i = 0; i < CHILDREN; i++) {
+            int c = 'A' + w * CHILDREN + i;
+            rc = Sys_Spawn(MakeName("Child", c), Child, (void *) c, USLOSS_MIN_STACK * 4, 3, &pid);
+            assert(rc == P1_SUCCESS);
+        }
+        for (int i = 0; i < CHILDREN; i++) {
+            rc = Sys_Wait(&pid, &status);
+            assert(rc == P1_SUCCESS);
+            TEST(status, 0);
+        }
+    }
+    rc = Sys_Sleep(1);
+    assert(rc == P1_SUCCESS);
+    TEST(P3_vmStats.freeFrames, FRAMES);
+    TEST(P3_vmStats.freeBlocks, P3_vmStats.blocks);
+    Sys_VmShutdown();
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_vmOptions.reaper = 1;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, CHILDREN * PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
@@ -0,0 +1,118 @@
+/*
+ * test_stripe.c
+ *
+ *  Tests swap striped across two disk units. A single child writes a signature into each
+ *  of its pages and reads them back, twice over. There are fewer frames than pages, so the
+ *  pages go to swap, and with a stripe of one slot consecutive slots are on alternate
+ *  units. The child checks its pages and both units must have done some of the I/O.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 8         // # of pages per process
+#define FRAMES 2        // # of frames
+#define ITERATIONS 2
+#define PAGERS 2        // # of pagers
+#define UNITS 2         // # of disk units swap is striped across
+
+#define OTHER_DISK ((P3_SWAP_DISK + 1) % USLOSS_DISK_UNITS)
+
+static char *vmRegion;
+static int  pageSize;
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+Child(void *arg)
+{
+    char    *page;
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int j = 0; j < PAGES; j++) {
+            page = vmRegion + j * pageSize;
+            Debug("Child writing page %d\n", j);
+            for (int k = 0; k < pageSize; k++) {
+                page[k] = 'A' + i + j;
+            }
+        }
+        for (int j = 0; j < PAGES; j++) {
+            page = vmRegion + j * pageSize;
+            Debug("Child reading page %d\n", j);
+            for (int k = 0; k < pageSize; k++) {
+                TEST(page[k], 'A' + i + j);
+            }
+        }
+    }
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    pageSize = USLOSS_MmuPageSize();
+    rc = Sys_Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 4, 3, &pid);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_Wait(&pid, &status);
+    assert(rc == P1_SUCCESS);
+    TEST(status, 0);
+    Sys_VmShutdown();
+
+    TEST(P3_swapStats.unitIOs[P3_SWAP_DISK] > 0, 1);
+    TEST(P3_swapStats.unitIOs[OTHER_DISK] > 0, 1);
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    P3_swapOptions.units = UNITS;
+    P3_swapOptions.stripe = 1;
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, PAGES);
+    assert(rc == 0);
+    rc = Disk_Create(NULL, OTHER_DISK, PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}
@@ -0,0 +1,135 @@
+/*
+ * test_teardown.c
+ *
+ *  Tests freeing a quitting process's memory without the reaper. Children "A", "B" and "C"
+ *  each write more pages than there are frames, so each has pages in frames and on the
+ *  swap disk, then wait. The parent lets them quit in a different order than they were
+ *  spawned, and each one must give back swap blocks as it quits. Once they have all quit
+ *  every frame and swap block must be free again.
+ *
+ */
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+#include <usloss.h>
+#include <stdlib.h>
+#include <phase3.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <libdisk.h>
+
+#include "tester.h"
+#include "phase3Int.h"
+
+#define PAGES 6         // # of pages per process
+#define FRAMES 4        // # of frames
+#define PAGERS 2        // # of pagers
+#define CHILDREN 3
+
+static char *vmRegion;
+static char *names[CHILDREN] = {"A","B","C"};
+static int  order[CHILDREN] = {1, 2, 0};    // order the children quit in
+static int  pageSize;
+static SID  written;
+static SID  quit[CHILDREN];
+
+static int passed = FALSE;
+
+#ifdef DEBUG
+static int debugging = 1;
+#else
+static int debugging = 0;
+#endif /* DEBUG */
+
+static void
+Debug(char *fmt, ...)
+{
+    va_list ap;
+
+    if (debugging) {
+        va_start(ap, fmt);
+        USLOSS_VConsole(fmt, ap);
+    }
+}
+
+static int
+Child(void *arg)
+{
+    int     i = (int) (long) arg;
+    char    *name = names[i];
+    char    *page;
+    int     rc;
+
+    for (int j = 0; j < PAGES; j++) {
+        page = vmRegion + j * pageSize;
+        Debug("Child \"%s\" writing page %d\n", name, j);
+        for (int k = 0; k < pageSize; k++) {
+            page[k] = *name + j;
+        }
+    }
+    rc = Sys_SemV(written);
+    assert(rc == P1_SUCCESS);
+    rc = Sys_SemP(quit[i]);
+    assert(rc == P1_SUCCESS);
+    Debug("Child \"%s\" quitting\n", name);
+    return 0;
+}
+
+int
+P4_Startup(void *arg)
+{
+    int     rc;
+    int     pid;
+    int     status;
+    int     freeBlocks;
+
+    Debug("P4_Startup starting.\n");
+    rc = Sys_VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    TEST(rc, P1_SUCCESS);
+
+    rc = Sys_SemCreate("written", 0, &written);
+    assert(rc == P1_SUCCESS);
+    for (int i = 0; i < CHILDREN; i++) {
+        rc = Sys_SemCreate(names[i], 0, &quit[i]);
+        assert(rc == P1_SUCCESS);
+    }
+
+    // the children write their pages one at a time so each of them ends up with swap
+    pageSize = USLOSS_MmuPageSize();
+    for (int i = 0; i < CHILDREN; i++) {
+        rc = Sys_Spawn(names[i], Child, (void *) (long) i, USLOSS_MIN_STACK * 4, 3, &pid);
+        assert(rc == P1_SUCCESS);
+        rc = Sys_SemP(written);
+        assert(rc == P1_SUCCESS);
+    }
+    for (int i = 0; i < CHILDREN; i++) {
+        freeBlocks = P3_vmStats.freeBlocks;
+        rc = Sys_SemV(quit[order[i]]);
+        assert(rc == P1_SUCCESS);
+        rc = Sys_Wait(&pid, &status);
+        assert(rc == P1_SUCCESS);
+        TEST(status, 0);
+        Debug("Child \"%s\" quit, free blocks %d -> %d\n", names[order[i]], freeBlocks,
+              P3_vmStats.freeBlocks);
+        TEST(P3_vmStats.freeBlocks > freeBlocks, 1);
+    }
+    TEST(P3_vmStats.freeFrames, FRAMES);
+    TEST(P3_vmStats.freeBlocks, P3_vmStats.blocks);
+    Sys_VmShutdown();
+    PASSED();
+    return 0;
+}
+
+
+void test_setup(int argc, char **argv) {
+    DeleteAllDisks();
+    int rc = Disk_Create(NULL, P3_SWAP_DISK, CHILDREN * PAGES);
+    assert(rc == 0);
+}
+
+void test_cleanup(int argc, char **argv) {
+    DeleteAllDisks();
+    if (passed) {
+        USLOSS_Console("TEST PASSED.\n");
+    }
+}